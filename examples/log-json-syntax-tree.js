@@ -11,7 +11,7 @@ const ASTRoot = csound.ParseOrc(Csound, `
 `);
 
 // Convert the AST to an object that is not backed by a Csound structure.
-const ASTObject = JSON.parse(JSON.stringify(ASTRoot));
+const ASTObject = csound.SerializeTree(ASTRoot);
 csound.DeleteTree(Csound, ASTRoot);
 csound.Destroy(Csound);
 
@@ -0,0 +1,175 @@
+// Measures the cost of frequently used functions of csound-api, and writes the
+// results as JSON so that runs can be compared across versions. Run this using
+//   npm run benchmark [-- path/to/results.json]
+// Csound performs with --nosound, so no audio device is needed.
+const csound = require('bindings')('csound-api.node');
+const fs = require('fs');
+
+csound.SetDefaultMessageCallback(() => {});
+
+const warmupSampleCount = 20;
+const sampleCount = 200;
+const callsPerSample = 1000;
+const roundTripCount = 500;
+
+const orchestra = `
+  nchnls = 1
+  sr = 44100
+  0dbfs = 1
+  ksmps = 32
+  instr 1
+    out oscili(0.1 * 0dbfs, 440)
+  endin
+`;
+
+function nanosecondsSince(startTime) {
+  return Number(process.hrtime.bigint() - startTime);
+}
+
+// Returns statistics of durations in nanoseconds.
+function statistics(durations) {
+  const sorted = Float64Array.from(durations).sort();
+  const mean = sorted.reduce((sum, duration) => sum + duration, 0) / sorted.length;
+  const variance = sorted.reduce((sum, duration) => sum + (duration - mean) ** 2, 0) / sorted.length;
+  const percentile = p => sorted[Math.min(sorted.length - 1, Math.floor(p / 100 * sorted.length))];
+  return {
+    samples: sorted.length,
+    meanNanoseconds: mean,
+    medianNanoseconds: percentile(50),
+    p95Nanoseconds: percentile(95),
+    minNanoseconds: sorted[0],
+    maxNanoseconds: sorted[sorted.length - 1],
+    standardDeviationNanoseconds: Math.sqrt(variance)
+  };
+}
+
+// Measures the mean duration of a function called callsPerSample times per
+// sample, after discarding warmup samples. If passed, afterSample is called
+// (and not timed) after each sample.
+function measureCalls(callFunction, afterSample) {
+  const durations = [];
+  for (let i = 0; i < warmupSampleCount + sampleCount; i++) {
+    const startTime = process.hrtime.bigint();
+    for (let j = 0; j < callsPerSample; j++)
+      callFunction(j);
+    if (i >= warmupSampleCount)
+      durations.push(nanosecondsSince(startTime) / callsPerSample);
+    if (afterSample)
+      afterSample();
+  }
+  return Object.assign(statistics(durations), {callsPerSample});
+}
+
+// Measures the time from calling sendFunction to the resolution of the promise
+// it returns, one round trip at a time.
+async function measureRoundTrips(sendFunction) {
+  const durations = [];
+  for (let i = 0; i < warmupSampleCount + roundTripCount; i++) {
+    const startTime = process.hrtime.bigint();
+    await sendFunction(i);
+    if (i >= warmupSampleCount)
+      durations.push(nanosecondsSince(startTime));
+  }
+  return statistics(durations);
+}
+
+// If passed, configure is called before Csound starts.
+function createCsound(configure) {
+  const Csound = csound.Create();
+  csound.SetOption(Csound, '--nosound');
+  if (configure)
+    configure(Csound);
+  csound.CompileOrc(Csound, orchestra);
+  csound.ReadScore(Csound, 'f 1 0 1024 10 1');
+  csound.Start(Csound);
+  return Csound;
+}
+
+// Starts an asynchronous performance that runs until the returned function is
+// called, and resolves when the performance finishes.
+function performAsynchronously(Csound) {
+  // Keep the performance going with a long note.
+  csound.ScoreEvent(Csound, 'i', [1, 0, 1e6]);
+  let finish;
+  const finished = new Promise(resolve => finish = resolve);
+  csound.PerformAsync(Csound, () => finish());
+  return () => {
+    csound.Stop(Csound);
+    return finished;
+  };
+}
+
+async function benchmark() {
+  const results = {};
+  let Csound = createCsound();
+
+  results.SetControlChannel = measureCalls(i => csound.SetControlChannel(Csound, 'benchmark', i));
+  results.GetControlChannel = measureCalls(() => csound.GetControlChannel(Csound, 'benchmark'));
+  results.TableSet = measureCalls(i => csound.TableSet(Csound, 1, i % 1024, i));
+  results.TableGet = measureCalls(i => csound.TableGet(Csound, 1, i % 1024));
+  // Perform the events sent in each sample so that they don’t accumulate.
+  const performKsmps = () => csound.PerformKsmps(Csound);
+  results.ScoreEvent = measureCalls(() => csound.ScoreEvent(Csound, 'i', [1, 0, 0.001]), performKsmps);
+  results.InputMessage = measureCalls(() => csound.InputMessage(Csound, 'i 1 0 0.001'), performKsmps);
+  results.PerformKsmps = measureCalls(performKsmps);
+
+  // While Csound performs asynchronously, score events are queued to run on the
+  // performance thread. Let the queue drain between samples so that calls
+  // aren’t rejected because the queue is full.
+  let stop = performAsynchronously(Csound);
+  const durations = [];
+  for (let i = 0; i < warmupSampleCount + sampleCount; i++) {
+    const startTime = process.hrtime.bigint();
+    for (let j = 0; j < 100; j++)
+      csound.ScoreEvent(Csound, 'i', [1, 0, 0.001]);
+    if (i >= warmupSampleCount)
+      durations.push(nanosecondsSince(startTime) / 100);
+    await new Promise(resolve => setTimeout(resolve, 1));
+  }
+  results.ScoreEventAsync = Object.assign(statistics(durations), {callsPerSample: 100});
+  await stop();
+  csound.Destroy(Csound);
+
+  // Message callbacks run on the main thread after a call to uv_async_send.
+  Csound = csound.Create();
+  let deliver;
+  csound.SetMessageCallback(Csound, () => deliver && deliver());
+  results.messageCallbackLatency = await measureRoundTrips(() => new Promise(resolve => {
+    deliver = resolve;
+    csound.Message(Csound, 'benchmark\n');
+  }));
+  csound.Destroy(Csound);
+
+  // Graph callbacks are measured from queuing a function table statement during
+  // an asynchronous performance to receiving the drawn table.
+  Csound = createCsound(Csound => {
+    csound.SetIsGraphable(Csound, true);
+    csound.SetMakeGraphCallback(Csound, () => {});
+    csound.SetDrawGraphCallback(Csound, () => deliver && deliver());
+  });
+  stop = performAsynchronously(Csound);
+  results.graphCallbackLatency = await measureRoundTrips(i => new Promise(resolve => {
+    deliver = resolve;
+    csound.InputMessage(Csound, `f ${2 + i % 100} 0 1024 10 1`);
+  }));
+  deliver = null;
+  await stop();
+  csound.Destroy(Csound);
+
+  return {
+    date: new Date().toISOString(),
+    node: process.version,
+    platform: `${process.platform}-${process.arch}`,
+    csoundVersion: csound.GetVersion(),
+    csoundAPIVersion: csound.GetAPIVersion(),
+    results
+  };
+}
+
+benchmark().then(report => {
+  const json = JSON.stringify(report, null, 2);
+  const outputPath = process.argv[2];
+  if (outputPath)
+    fs.writeFileSync(outputPath, json + '\n');
+  console.log(json);
+});
@@ -123,6 +123,27 @@ describe('Csound API', () => {
     expect(() => csound.Destroy(Csound)).not.toThrow();
   });
 
+  it('acquires and releases instances from an instance pool', done => {
+    const instancePool = csound.CreateInstancePool({size: 1, options: ['--nosound']});
+    const acquireWhenIdle = () => {
+      if (instancePool.idleCount === 0) {
+        setTimeout(acquireWhenIdle, 10);
+        return;
+      }
+      const Csound = instancePool.acquire('host data');
+      expect(csound.GetHostData(Csound)).toBe('host data');
+      expect(csound.CompileOrc(Csound, 'instr 1\nendin')).toBe(csound.SUCCESS);
+      expect(() => instancePool.release(Csound)).not.toThrow();
+      const stats = instancePool.acquisitionStats;
+      expect(stats.count).toBe(1);
+      expect(stats.coldCount).toBe(0);
+      expect(stats.maxMilliseconds).toBeGreaterThanOrEqual(stats.meanMilliseconds);
+      instancePool.close();
+      done();
+    };
+    acquireWhenIdle();
+  });
+
   describe('creates instance with host data that', () => {
     let Csound;
     afterEach(() => csound.Destroy(Csound));
@@ -200,6 +221,45 @@ describe('Csound instance', () => {
       expect(csound.ParseOrc(Csound, '')).toBeNull();
     });
 
+    it('serializes abstract syntax tree', () => {
+      const ASTRoot = csound.ParseOrc(Csound, orchestraHeader);
+      const ASTObject = JSON.parse(JSON.stringify(ASTRoot));
+      expect(csound.SerializeTree(ASTRoot)).toEqual(ASTObject);
+      expect(JSON.parse(csound.SerializeTree(ASTRoot, {format: 'json'}))).toEqual(ASTObject);
+      const flatTree = csound.SerializeTree(ASTRoot, {format: 'flat'});
+      expect(flatTree.nodes instanceof Int32Array).toBe(true);
+      expect(flatTree.nodes.length).toBe(flatTree.locations.length * flatTree.nodeStride);
+      expect(flatTree.nodes[0]).toBe(ASTObject.type);
+      expect(flatTree.strings[flatTree.tokens[flatTree.nodes[4] * flatTree.tokenStride + 2]]).toBe(ASTObject.value.lexeme);
+      expect(() => csound.SerializeTree(ASTRoot, {format: 'xml'})).toThrow();
+      csound.DeleteTree(Csound, ASTRoot);
+    });
+
+    it('queries abstract syntax tree', () => {
+      const ASTRoot = csound.ParseOrc(Csound, `
+        ${orchestraHeader}
+        giSine ftgen 0, 0, 16384, 10, 1
+        instr A440
+          kAmplitude chnget "Amplitude"
+          aSignal oscili kAmplitude, 440, giSine
+          chnset kAmplitude, "Level"
+          out aSignal
+        endin
+        instr 2
+          iLength ftlen 1
+          turnoff
+        endin
+      `);
+      expect(csound.QueryTree(Csound, ASTRoot, 'instruments')).toEqual(['A440', '2']);
+      expect(csound.QueryTree(Csound, ASTRoot, {select: 'opcodes', instrument: 'A440'})).toEqual(['chnget', 'oscili', 'chnset', 'out']);
+      expect(csound.QueryTree(Csound, ASTRoot, 'channels')).toEqual({read: ['Amplitude'], written: ['Level']});
+      expect(csound.QueryTree(Csound, ASTRoot, 'tables')).toEqual(['giSine', '1']);
+      const lines = csound.QueryTree(Csound, ASTRoot, {select: 'lines', lexemes: ['turnoff']});
+      expect(lines instanceof Int32Array).toBe(true);
+      expect(lines.length).toBe(1);
+      csound.DeleteTree(Csound, ASTRoot);
+    });
+
     it('compiles abstract syntax tree', () => {
       const ASTRoot = csound.ParseOrc(Csound, orchestraHeader);
       expect(csound.CompileTree(Csound, ASTRoot)).toBe(csound.SUCCESS);
@@ -211,6 +271,51 @@ describe('Csound instance', () => {
       expect(csound.CompileOrc(Csound, '')).toBe(csound.ERROR);
     });
 
+    it('caches parse trees of orchestra strings', () => {
+      expect(csound.GetParseTreeCacheStats(Csound)).toBeNull();
+      csound.SetParseTreeCache(Csound, {maxEntries: 1});
+      const orchestra = `
+        instr 1
+          prints "hello, world"
+        endin
+      `;
+      expect(csound.CompileOrc(Csound, orchestra)).toBe(csound.SUCCESS);
+      expect(csound.CompileOrc(Csound, orchestra)).toBe(csound.SUCCESS);
+      expect(csound.CompileOrc(Csound, orchestraHeader)).toBe(csound.SUCCESS);
+      expect(csound.CompileOrc(Csound, '')).toBe(csound.ERROR);
+      const stats = csound.GetParseTreeCacheStats(Csound);
+      expect(stats.hits).toBe(1);
+      expect(stats.misses).toBe(3);
+      expect(stats.evictions).toBe(1);
+      expect(stats.entries).toBe(1);
+      expect(stats.bytes).toBe(orchestraHeader.length);
+    });
+
+    it('performs orchestras compiled from cached parse trees', () => {
+      expect(csound.SetOption(Csound, '--nosound')).toBe(csound.SUCCESS);
+      csound.SetParseTreeCache(Csound, {});
+      expect(csound.CompileOrc(Csound, orchestraHeader)).toBe(csound.SUCCESS);
+      const orchestra = `
+        opcode Double, i, i
+          iValue xin
+          xout 2 * iValue
+        endop
+        instr 1
+          chnset Double(21), "Result"
+        endin
+      `;
+      expect(csound.CompileOrc(Csound, orchestra)).toBe(csound.SUCCESS);
+      expect(csound.CompileOrc(Csound, orchestra)).toBe(csound.SUCCESS);
+      expect(csound.GetParseTreeCacheStats(Csound).hits).toBe(1);
+      expect(csound.ReadScore(Csound, `
+        i 1 0 0.01
+        e
+      `)).toBe(csound.SUCCESS);
+      expect(csound.Start(Csound)).toBe(csound.SUCCESS);
+      expect(csound.Perform(Csound)).toBeGreaterThan(0);
+      expect(csound.GetControlChannel(Csound, 'Result')).toBe(42);
+    });
+
     it('evaluates code with return opcode', () => {
       expect(csound.SetOption(Csound, '--nosound')).toBe(csound.SUCCESS);
       expect(csound.Start(Csound)).toBe(csound.SUCCESS);
@@ -369,6 +474,32 @@ describe('Csound instance', () => {
       expect(csound.GetCurrentTimeSamples(Csound)).toBe(sampleRate);
     });
 
+    it('gets audio input and output buffers', () => {
+      expect(csound.SetOption(Csound, '--nosound')).toBe(csound.SUCCESS);
+      expect(csound.CompileOrc(Csound, `
+        ${orchestraHeader}
+        instr 1
+          out 0.5 * 0dbfs
+        endin
+      `)).toBe(csound.SUCCESS);
+      expect(csound.ReadScore(Csound, `
+        i 1 0 1
+        e
+      `)).toBe(csound.SUCCESS);
+      expect(csound.Start(Csound)).toBe(csound.SUCCESS);
+      const spin = csound.GetSpin(Csound);
+      expect(spin).toBeInstanceOf(Float64Array);
+      expect(spin.length).toBe(samplesPerControlPeriod);
+      const spout = csound.GetSpout(Csound);
+      expect(spout).toBeInstanceOf(Float64Array);
+      expect(spout.length).toBe(samplesPerControlPeriod * outputChannelCount);
+      expect(csound.GetSpout(Csound)).toBe(spout);
+      expect(csound.PerformKsmps(Csound)).toBe(false);
+      expect(spout[samplesPerControlPeriod - 1]).toBe(0.5 * fullScalePeakAmplitude);
+      csound.Reset(Csound);
+      expect(spout.length).toBe(0);
+    });
+
     it('gets default host data', () => {
       expect(csound.GetHostData(Csound)).toBeUndefined();
     });
@@ -537,6 +668,80 @@ describe('Csound instance', () => {
       expect(csound.GetControlChannel(Csound, name)).toBe(42);
     });
 
+    it('sets and gets control channel value using a handle', () => {
+      const name = 'test';
+      const handle = csound.GetChannelHandle(Csound, name);
+      expect(handle).not.toBeNull();
+      handle.set(42);
+      expect(handle.get()).toBe(42);
+      expect(csound.GetControlChannel(Csound, name)).toBe(42);
+      csound.SetControlChannel(Csound, name, 7);
+      expect(handle.get()).toBe(7);
+      expect(() => csound.GetChannelHandle(Csound, name, csound.AUDIO_CHANNEL)).toThrowError(TypeError);
+      csound.Reset(Csound);
+      expect(() => handle.get()).toThrow();
+    });
+
+    it('sets and gets control channel values in bulk', () => {
+      const names = ['test1', 'test2', 'test3'];
+      const values = new Float64Array([1, 2, 3]);
+      expect(csound.SetControlChannels(Csound, names, values)).toBe(csound.SUCCESS);
+      expect(csound.GetControlChannel(Csound, 'test2')).toBe(2);
+      const channelSet = csound.GetChannelSet(Csound, names);
+      expect(channelSet.length).toBe(3);
+      csound.SetControlChannels(Csound, channelSet, new Float64Array([4, 5, 6]));
+      const output = new Float64Array(3);
+      expect(csound.GetControlChannels(Csound, channelSet, output)).toBe(csound.SUCCESS);
+      expect(Array.from(output)).toEqual([4, 5, 6]);
+      expect(() => csound.GetControlChannels(Csound, names, new Float64Array(2))).toThrowError(RangeError);
+      csound.Reset(Csound);
+      expect(() => csound.GetControlChannels(Csound, channelSet, output)).toThrow();
+    });
+
+    it('sets and gets audio channel samples', () => {
+      expect(csound.SetOption(Csound, '--nosound')).toBe(csound.SUCCESS);
+      expect(csound.CompileOrc(Csound, `
+        ${orchestraHeader}
+        chn_a "Input", 1
+        chn_a "Output", 2
+        instr 1
+          aInput chnget "Input"
+          chnset aInput * 2, "Output"
+        endin
+      `)).toBe(csound.SUCCESS);
+      expect(csound.ReadScore(Csound, `
+        i 1 0 1
+        e
+      `)).toBe(csound.SUCCESS);
+      expect(csound.Start(Csound)).toBe(csound.SUCCESS);
+      const samples = new Float64Array(samplesPerControlPeriod).fill(0.25);
+      csound.SetAudioChannel(Csound, 'Input', samples);
+      expect(csound.PerformKsmps(Csound)).toBe(false);
+      samples.fill(0);
+      csound.GetAudioChannel(Csound, 'Output', samples);
+      expect(samples).toEqual(new Float64Array(samplesPerControlPeriod).fill(0.5));
+      expect(() => csound.GetAudioChannel(Csound, 'Output', [])).toThrowError(TypeError);
+      expect(() => csound.SetAudioChannel(Csound, 'Input', new Float64Array(1))).toThrowError(RangeError);
+    });
+
+    it('copies function tables', () => {
+      expect(csound.SetOption(Csound, '--nosound')).toBe(csound.SUCCESS);
+      expect(csound.CompileOrc(Csound, `
+        ${orchestraHeader}
+        giTable ftgen 1, 0, 8, -2, 1, 2, 3, 4, 5, 6, 7, 8
+      `)).toBe(csound.SUCCESS);
+      expect(csound.Start(Csound)).toBe(csound.SUCCESS);
+      const values = new Float64Array(8);
+      expect(csound.TableCopyOut(Csound, 1, values)).toBe(8);
+      expect(values).toEqual(new Float64Array([1, 2, 3, 4, 5, 6, 7, 8]));
+      expect(csound.TableCopyIn(Csound, 1, new Float32Array([8, 7, 6, 5, 4, 3, 2, 1]))).toBe(8);
+      expect(csound.TableGet(Csound, 1, 0)).toBe(8);
+      expect(csound.TableCopyOut(Csound, 2, values)).toBe(-1);
+      expect(csound.TableCopyIn(Csound, 2, values)).toBe(-1);
+      expect(() => csound.TableCopyOut(Csound, 1, new Float64Array(4))).toThrowError(RangeError);
+      expect(() => csound.TableCopyIn(Csound, 1, [])).toThrowError(TypeError);
+    });
+
     it('populates and deletes opcode list', () => {
       const opcodeList = [];
       expect(opcodeList.length).toBe(0);
@@ -547,6 +752,21 @@ describe('Csound instance', () => {
       expect(opcodeList.length).toBe(0);
     });
 
+    it('gets indexed opcode table and signatures', () => {
+      const opcodeTable = csound.GetOpcodeTable(Csound);
+      expect(opcodeTable.length).toBeGreaterThan(0);
+      expect(opcodeTable.names.length).toBe(opcodeTable.length);
+      expect(opcodeTable.flags.length).toBe(opcodeTable.length);
+      const opcodeNames = Array.from(opcodeTable.names, index => opcodeTable.strings[index]);
+      expect(opcodeNames).toContain('oscili');
+      const signatures = csound.GetOpcodeSignatures(Csound, 'oscili');
+      expect(signatures.length).toBeGreaterThan(0);
+      for (const signature of signatures)
+        expect(typeof signature.intypes).toBe('string');
+      expect(csound.GetOpcodeSignatures(Csound, 'oscili.kk')).toEqual(signatures);
+      expect(csound.GetOpcodeSignatures(Csound, 'no_such_opcode')).toBeNull();
+    });
+
     it('gets environment variable value', () => {
       expect(csound.SetGlobalEnv('SFDIR', __dirname)).toBe(csound.SUCCESS);
       const Csound = csound.Create();
@@ -589,6 +809,105 @@ describe('Csound instance', () => {
       setTimeout(() => csound.Stop(Csound), 600);
     });
 
+    it('compiles and starts on a worker thread', done => {
+      const Csound = csound.Create();
+      expect(csound.SetOption(Csound, '--nosound')).toBe(csound.SUCCESS);
+      const promise = csound.CompileOrcAsync(Csound, `
+        ${orchestraHeader}
+        instr 1
+          out oscili(0.1 * 0dbfs, 440)
+        endin
+      `);
+      expect(promise instanceof Promise).toBe(true);
+      expect(() => csound.Start(Csound)).toThrow();
+      expect(() => csound.SetParseTreeCache(Csound, null)).toThrow();
+      expect(() => csound.GetControlChannel(Csound, 'test')).toThrow();
+      promise
+        .then(status => {
+          expect(status).toBe(csound.SUCCESS);
+          return csound.StartAsync(Csound);
+        })
+        .then(status => {
+          expect(status).toBe(csound.SUCCESS);
+          expect(csound.GetSr(Csound)).toBe(sampleRate);
+          csound.Destroy(Csound);
+          done();
+        });
+    });
+
+    it('performs on a dedicated thread', done => {
+      const Csound = csound.Create();
+      expect(csound.SetOption(Csound, '--nosound')).toBe(csound.SUCCESS);
+      expect(csound.CompileOrc(Csound, `
+        ${orchestraHeader}
+        instr 1
+          out oscili(0.1 * 0dbfs, 440)
+        endin
+      `)).toBe(csound.SUCCESS);
+      expect(csound.ReadScore(Csound, `
+        i 1 0 0.1
+        e
+      `)).toBe(csound.SUCCESS);
+      expect(csound.Start(Csound)).toBe(csound.SUCCESS);
+      // Without permission to use real-time scheduling, Csound still performs.
+      csound.PerformAsync(Csound, result => {
+        expect(result).toBeGreaterThan(0);
+        csound.Destroy(Csound);
+        done();
+      }, {priority: 80, cpus: [0]});
+    });
+
+    it('gets performance stats', done => {
+      const Csound = csound.Create();
+      expect(csound.SetOption(Csound, '--nosound')).toBe(csound.SUCCESS);
+      expect(csound.CompileOrc(Csound, `
+        ${orchestraHeader}
+        instr 1
+          out oscili(0.1 * 0dbfs, 440)
+        endin
+      `)).toBe(csound.SUCCESS);
+      expect(csound.ReadScore(Csound, `
+        i 1 0 0.1
+        e
+      `)).toBe(csound.SUCCESS);
+      expect(csound.Start(Csound)).toBe(csound.SUCCESS);
+      csound.PerformAsync(Csound, result => {
+        const stats = csound.GetPerformanceStats(Csound);
+        expect(stats.controlPeriods).toBeGreaterThan(0);
+        expect(stats.budgetMilliseconds).toBeCloseTo(1000 * samplesPerControlPeriod / sampleRate);
+        expect(stats.performKsmps.count).toBe(stats.controlPeriods);
+        expect(stats.performKsmps.p50).toBeLessThanOrEqual(stats.performKsmps.p99);
+        expect(stats.performKsmps.maxMilliseconds).toBeGreaterThan(0);
+        expect(stats.dspLoad).toBeGreaterThan(0);
+        csound.Destroy(Csound);
+        done();
+      });
+    });
+
+    it('counts queued calls', done => {
+      const Csound = csound.Create();
+      expect(csound.SetOption(Csound, '--nosound')).toBe(csound.SUCCESS);
+      expect(csound.CompileOrc(Csound, `
+        ${orchestraHeader}
+        instr 1
+          out oscili(0.1 * 0dbfs, 440)
+        endin
+      `)).toBe(csound.SUCCESS);
+      expect(csound.Start(Csound)).toBe(csound.SUCCESS);
+      const names = csound.GetBindingCounterNames();
+      const counter = name => csound.GetBindingCounters(Csound)[names.indexOf(name)];
+      csound.PerformAsync(Csound, result => {
+        expect(counter('commandsExecuted')).toBe(2);
+        expect(counter('commandQueueDepth')).toBe(0);
+        expect(counter('commandQueuePeakDepth')).toBeGreaterThan(0);
+        csound.Destroy(Csound);
+        done();
+      });
+      csound.ScoreEvent(Csound, 'i', [1, 0, 0.1]);
+      csound.InputMessage(Csound, 'i 1 0 0.1');
+      setTimeout(() => csound.Stop(Csound), 200);
+    });
+
     it('performs control periods', done => {
       const Csound = csound.Create();
       expect(csound.SetOption(Csound, '--output=dac')).toBe(csound.SUCCESS);
@@ -616,6 +935,181 @@ describe('Csound instance', () => {
       });
     });
 
+    it('performs control periods with progress data', done => {
+      const Csound = csound.Create();
+      expect(csound.SetOption(Csound, '--nosound')).toBe(csound.SUCCESS);
+      expect(csound.CompileOrc(Csound, `
+        ${orchestraHeader}
+        instr 1
+          chnset 42, "Output"
+        endin
+      `)).toBe(csound.SUCCESS);
+      expect(csound.ReadScore(Csound, `
+        i 1 0 0.1
+        e
+      `)).toBe(csound.SUCCESS);
+      expect(csound.Start(Csound)).toBe(csound.SUCCESS);
+      let performedSampleCount = 0;
+      csound.PerformKsmpsAsync(Csound, (sampleCount, scoreTime, values) => {
+        expect(sampleCount).toBeGreaterThan(performedSampleCount);
+        expect(sampleCount % (4 * samplesPerControlPeriod)).toBe(0);
+        expect(scoreTime).toBeCloseTo(sampleCount / sampleRate, 6);
+        expect(values.length).toBe(1);
+        performedSampleCount = sampleCount;
+      }, () => {
+        expect(performedSampleCount).toBeGreaterThan(0);
+        csound.Destroy(Csound);
+        done();
+      }, {controlPeriods: 4, channels: ['Output']});
+    });
+
+    it('renders asynchronously', done => {
+      const Csound = csound.Create();
+      expect(csound.SetOption(Csound, '--nosound')).toBe(csound.SUCCESS);
+      expect(csound.CompileOrc(Csound, `
+        ${orchestraHeader}
+        instr 1
+          out 0.5 * 0dbfs
+        endin
+      `)).toBe(csound.SUCCESS);
+      expect(csound.ReadScore(Csound, `
+        i 1 0 1
+        e
+      `)).toBe(csound.SUCCESS);
+      expect(csound.Start(Csound)).toBe(csound.SUCCESS);
+      csound.RenderAsync(Csound, {format: 'float32', frames: 1}, (result, samples, stats) => {
+        expect(result).toBeGreaterThan(0);
+        expect(samples instanceof Float32Array).toBe(true);
+        expect(samples.length).toBe(stats.frames * stats.channels);
+        expect(stats.frames).toBeGreaterThanOrEqual(sampleRate);
+        expect(stats.reallocations).toBeGreaterThan(0);
+        expect(samples[0]).toBe(0.5 * fullScalePeakAmplitude);
+        csound.Destroy(Csound);
+        done();
+      });
+    });
+
+    it('renders CSDs in a render pool', done => {
+      const renderPool = csound.CreateRenderPool({threads: 2});
+      expect(renderPool.threadCount).toBe(2);
+      const amplitudes = [0.1, 0.2, 0.3, 0.4];
+      let renderedCSDCount = 0;
+      for (const amplitude of amplitudes) {
+        // Output options of jobs take precedence over <CsOptions>.
+        renderPool.render(`
+          <CsoundSynthesizer>
+          <CsOptions>
+          -odac
+          </CsOptions>
+          <CsInstruments>
+          ${orchestraHeader}
+          instr 1
+            out ${amplitude} * 0dbfs
+          endin
+          </CsInstruments>
+          <CsScore>
+          i 1 0 0.1
+          e
+          </CsScore>
+          </CsoundSynthesizer>
+        `, {format: 'float32'}, (result, samples, stats) => {
+          expect(result).toBeGreaterThan(0);
+          expect(samples.length).toBe(stats.frames * outputChannelCount);
+          expect(samples[0]).toBeCloseTo(amplitude * fullScalePeakAmplitude, 6);
+          if (++renderedCSDCount === amplitudes.length) {
+            expect(renderPool.pendingJobCount).toBe(0);
+            renderPool.close();
+            done();
+          }
+        });
+      }
+      expect(renderPool.pendingJobCount).toBe(amplitudes.length);
+    });
+
+    it('passes error messages of render pool jobs', done => {
+      const renderPool = csound.CreateRenderPool({threads: 1});
+      renderPool.render(`
+        <CsoundSynthesizer>
+        <CsInstruments>
+        ${orchestraHeader}
+        instr 1
+          out undefinedOpcode()
+        endin
+        </CsInstruments>
+        </CsoundSynthesizer>
+      `, (result, samples, stats, messages) => {
+        expect(result).not.toBe(csound.SUCCESS);
+        expect(messages.length).toBeGreaterThan(0);
+        renderPool.close();
+        done();
+      });
+    });
+
+    it('streams output samples', done => {
+      const Csound = csound.Create();
+      expect(csound.SetOption(Csound, '--nosound')).toBe(csound.SUCCESS);
+      expect(csound.CompileOrc(Csound, `
+        ${orchestraHeader}
+        instr 1
+          out oscili(0.5 * 0dbfs, 440)
+        endin
+      `)).toBe(csound.SUCCESS);
+      expect(csound.ReadScore(Csound, `
+        i 1 0 0.1
+        e
+      `)).toBe(csound.SUCCESS);
+      expect(csound.Start(Csound)).toBe(csound.SUCCESS);
+      let byteCount = 0;
+      const outputStream = csound.CreateOutputStream(Csound, {format: 'float32', bufferFrames: 4 * samplesPerControlPeriod}, buffer => {
+        if (buffer) {
+          byteCount += buffer.length;
+          // Pause and resume to make the performance wait for this function.
+          outputStream.pause();
+          setImmediate(() => outputStream.resume());
+        } else {
+          expect(byteCount).toBe(csound.GetCurrentTimeSamples(Csound) * outputChannelCount * Float32Array.BYTES_PER_ELEMENT);
+          expect(outputStream.droppedFrameCount).toBe(0);
+          csound.Destroy(Csound);
+          done();
+        }
+      });
+      csound.PerformAsync(Csound, result => expect(result).toBeGreaterThan(0));
+    });
+
+    it('streams input samples', done => {
+      const Csound = csound.Create();
+      expect(csound.SetOption(Csound, '--nosound')).toBe(csound.SUCCESS);
+      expect(csound.CompileOrc(Csound, `
+        ${orchestraHeader}
+        nchnls_i = 1
+        instr 1
+          chnset k(inch(1)), "Input"
+        endin
+      `)).toBe(csound.SUCCESS);
+      expect(csound.ReadScore(Csound, `
+        i 1 0 0.01
+        e
+      `)).toBe(csound.SUCCESS);
+      expect(csound.Start(Csound)).toBe(csound.SUCCESS);
+      const inputStream = csound.CreateInputStream(Csound, {format: 'float64', bufferFrames: 4 * samplesPerControlPeriod});
+      const samples = new Float64Array(samplesPerControlPeriod).fill(0.25);
+      let writeCount = 0;
+      const write = () => {
+        if (++writeCount < 100)
+          inputStream.write(Buffer.from(samples.buffer), write);
+        else
+          inputStream.end();
+      };
+      write();
+      csound.PerformAsync(Csound, result => {
+        expect(result).toBeGreaterThan(0);
+        expect(csound.GetControlChannel(Csound, 'Input')).toBe(0.25);
+        expect(inputStream.underrunFrameCount).toBe(0);
+        csound.Destroy(Csound);
+        done();
+      });
+    });
+
     it('sets message callback', done => {
       const Csound = csound.Create();
       csound.SetMessageCallback(Csound, (attributes, string) => {
@@ -627,6 +1121,36 @@ describe('Csound instance', () => {
       csound.Message(Csound, 'hello, world\n');
     });
 
+    it('sets message callback that receives batches', done => {
+      const Csound = csound.Create();
+      csound.SetMessageCallback(Csound, (messages, attributes, droppedMessageCount) => {
+        expect(attributes.length).toBe(messages.length);
+        expect(droppedMessageCount).toBe(0);
+        if (messages.includes('hello, world\n')) {
+          csound.Destroy(Csound);
+          done();
+        }
+      }, {batch: true});
+      csound.Message(Csound, 'hello, world\n');
+    });
+
+    it('sets message callback that filters messages', done => {
+      const Csound = csound.Create();
+      const strings = [];
+      csound.SetMessageCallback(Csound, (attributes, string) => {
+        strings.push(string);
+        if (string === 'done\n') {
+          expect(strings).toEqual(['warning\n', 'done\n']);
+          csound.Destroy(Csound);
+          done();
+        }
+      }, {messageTypes: [csound.MSG_WARNING, csound.MSG_ERROR], excludedPrefixes: ['ignored']});
+      csound.Message(Csound, 'default\n');
+      csound.MessageS(Csound, csound.MSG_WARNING, 'warning\n');
+      csound.MessageS(Csound, csound.MSG_WARNING, 'ignored warning\n');
+      csound.MessageS(Csound, csound.MSG_ERROR, 'done\n');
+    });
+
     it('receives score events', done => {
       const Csound = csound.Create();
       expect(csound.SetOption(Csound, '--nosound')).toBe(csound.SUCCESS);
@@ -640,6 +1164,27 @@ describe('Csound instance', () => {
       expect(csound.ScoreEvent(Csound, 'e')).toBe(csound.SUCCESS);
     });
 
+    it('receives batches of score events', done => {
+      const Csound = csound.Create();
+      expect(csound.SetOption(Csound, '--nosound')).toBe(csound.SUCCESS);
+      expect(csound.CompileOrc(Csound, `
+        ${orchestraHeader}
+        instr 1
+          chnset p4, "Output"
+        endin
+      `)).toBe(csound.SUCCESS);
+      expect(csound.Start(Csound)).toBe(csound.SUCCESS);
+      csound.PerformAsync(Csound, result => {
+        expect(result).toBeGreaterThan(0);
+        expect(csound.GetControlChannel(Csound, 'Output')).toBe(3);
+        csound.Destroy(Csound);
+        done();
+      });
+      const parameterFieldValues = new Float64Array([1, 0, 1, 1, 1, 0, 1, 2, 1, 0, 1, 3]);
+      expect(() => csound.ScoreEvents(Csound, 'i', parameterFieldValues, new Int32Array([0, 20]))).toThrowError(RangeError);
+      expect(csound.ScoreEvents(Csound, 'iiie', parameterFieldValues, new Int32Array([0, 4, 8, 12, 12]))).toBe(csound.SUCCESS);
+    });
+
     it('receives score statement messages', done => {
       const Csound = csound.Create();
       expect(csound.SetOption(Csound, '--nosound')).toBe(csound.SUCCESS);
@@ -653,6 +1198,26 @@ describe('Csound instance', () => {
       csound.InputMessage(Csound, 'e');
     });
 
+    it('sets audio channel samples', done => {
+      const Csound = csound.Create();
+      expect(csound.SetOption(Csound, '--nosound')).toBe(csound.SUCCESS);
+      expect(csound.CompileOrc(Csound, `
+        ${orchestraHeader}
+        chn_a "Input", 1
+      `)).toBe(csound.SUCCESS);
+      expect(csound.Start(Csound)).toBe(csound.SUCCESS);
+      csound.PerformAsync(Csound, result => {
+        expect(result).toBeGreaterThan(0);
+        const samples = new Float64Array(samplesPerControlPeriod);
+        csound.GetAudioChannel(Csound, 'Input', samples);
+        expect(samples).toEqual(new Float64Array(samplesPerControlPeriod).fill(0.25));
+        csound.Destroy(Csound);
+        done();
+      });
+      csound.SetAudioChannel(Csound, 'Input', new Float64Array(samplesPerControlPeriod).fill(0.25));
+      csound.InputMessage(Csound, 'e');
+    });
+
     it('gets and sets function table values', done => {
       const Csound = csound.Create();
       expect(csound.SetOption(Csound, '--nosound')).toBe(csound.SUCCESS);
@@ -674,6 +1239,26 @@ describe('Csound instance', () => {
       });
     });
 
+    it('copies values into function table', done => {
+      const Csound = csound.Create();
+      expect(csound.SetOption(Csound, '--nosound')).toBe(csound.SUCCESS);
+      expect(csound.CompileOrc(Csound, `
+        ${orchestraHeader}
+        giTable ftgen 1, 0, 4, -2, 0
+      `)).toBe(csound.SUCCESS);
+      expect(csound.Start(Csound)).toBe(csound.SUCCESS);
+      csound.PerformAsync(Csound, result => {
+        expect(result).toBeGreaterThan(0);
+        const values = new Float64Array(4);
+        expect(csound.TableCopyOut(Csound, 1, values)).toBe(4);
+        expect(values).toEqual(new Float64Array([1, 2, 3, 4]));
+        csound.Destroy(Csound);
+        done();
+      });
+      expect(csound.TableCopyIn(Csound, 1, new Float64Array([1, 2, 3, 4]))).toBe(4);
+      csound.InputMessage(Csound, 'e');
+    });
+
     it('sets graph callbacks', done => {
       const Csound = csound.Create();
       expect(csound.SetOption(Csound, '--nosound')).toBe(csound.SUCCESS);
@@ -681,6 +1266,8 @@ describe('Csound instance', () => {
       expect(csound.SetIsGraphable(Csound, true)).toBe(true);
       csound.SetMakeGraphCallback(Csound, (data, name) => {});
       csound.SetDrawGraphCallback(Csound, data => {
+        expect(data.fdata).toEqual(jasmine.any(Float64Array));
+        expect(data.fdata).toBe(data.fdata);
         csound.Destroy(Csound);
         done();
       });
@@ -692,5 +1279,30 @@ describe('Csound instance', () => {
       expect(csound.Start(Csound)).toBe(csound.SUCCESS);
       expect(csound.Perform(Csound)).toBeGreaterThan(0);
     });
+
+    it('sets graph callback that coalesces frames', done => {
+      const Csound = csound.Create();
+      expect(csound.SetOption(Csound, '--nosound')).toBe(csound.SUCCESS);
+      csound.SetIsGraphable(Csound, true);
+      csound.SetMakeGraphCallback(Csound, (data, name) => {});
+      // Both drawings of table 1 happen before the event loop turns, so the
+      // draw graph callback should be called once with the second drawing.
+      const drawnFrames = [];
+      csound.SetDrawGraphCallback(Csound, data => drawnFrames.push(data), {coalesces: true});
+      expect(csound.CompileOrc(Csound, orchestraHeader)).toBe(csound.SUCCESS);
+      expect(csound.ReadScore(Csound, `
+        f 1 0 16384 10 1
+        f 1 0 16384 10 1 0.5
+        e
+      `)).toBe(csound.SUCCESS);
+      expect(csound.Start(Csound)).toBe(csound.SUCCESS);
+      expect(csound.Perform(Csound)).toBeGreaterThan(0);
+      setTimeout(() => {
+        expect(drawnFrames.length).toBe(1);
+        expect(drawnFrames[0].fdata.length).toBeGreaterThan(0);
+        csound.Destroy(Csound);
+        done();
+      }, 100);
+    });
   });
 });
@@ -1,7 +1,112 @@
 #include <boost/lockfree/queue.hpp>
+#include <boost/lockfree/spsc_queue.hpp>
 #include <boost/utility/value_init.hpp>
 #include <csound/cwindow.h>
 #include <nan.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// CsoundBindingCounters count activity in the queues between Csound and
+// JavaScript for one instance of Csound: the depth and peak depth of the
+// command queue used while performing asynchronously and of each callback’s
+// arguments queue, calls to uv_async_send and to JavaScript callback
+// functions, and memory allocated for queued data. Counters are updated from
+// any thread using relaxed atomics, and are read together as a Float64Array.
+#define CSOUND_BINDING_COUNTERS(COUNTER) \
+  COUNTER(CommandQueueDepth, "commandQueueDepth") \
+  COUNTER(CommandQueuePeakDepth, "commandQueuePeakDepth") \
+  COUNTER(CommandsExecuted, "commandsExecuted") \
+  COUNTER(CommandsPerSecond, "commandsPerSecond") \
+  COUNTER(MessageQueueDepth, "messageQueueDepth") \
+  COUNTER(MessageQueuePeakDepth, "messageQueuePeakDepth") \
+  COUNTER(FileOpenQueueDepth, "fileOpenQueueDepth") \
+  COUNTER(FileOpenQueuePeakDepth, "fileOpenQueuePeakDepth") \
+  COUNTER(MakeGraphQueueDepth, "makeGraphQueueDepth") \
+  COUNTER(MakeGraphQueuePeakDepth, "makeGraphQueuePeakDepth") \
+  COUNTER(DrawGraphQueueDepth, "drawGraphQueueDepth") \
+  COUNTER(DrawGraphQueuePeakDepth, "drawGraphQueuePeakDepth") \
+  COUNTER(KillGraphQueueDepth, "killGraphQueueDepth") \
+  COUNTER(KillGraphQueuePeakDepth, "killGraphQueuePeakDepth") \
+  COUNTER(AsyncSends, "asyncSends") \
+  COUNTER(CallbackCalls, "callbackCalls") \
+  COUNTER(AllocatedBytes, "allocatedBytes") \
+  COUNTER(QueuedBytes, "queuedBytes")
+
+enum CsoundBindingCounter {
+#define CSOUND_BINDING_COUNTER_ENUMERATOR(name, key) CsoundBindingCounter ## name,
+  CSOUND_BINDING_COUNTERS(CSOUND_BINDING_COUNTER_ENUMERATOR)
+#undef CSOUND_BINDING_COUNTER_ENUMERATOR
+  CsoundBindingCounterCount
+};
+
+static const char *CsoundBindingCounterKeys[] = {
+#define CSOUND_BINDING_COUNTER_KEY(name, key) key,
+  CSOUND_BINDING_COUNTERS(CSOUND_BINDING_COUNTER_KEY)
+#undef CSOUND_BINDING_COUNTER_KEY
+};
+
+struct CsoundBindingCounters {
+  std::atomic<uint64_t> values[CsoundBindingCounterCount];
+  // Used on the main thread to compute CommandsPerSecond since the last time
+  // the counters were read.
+  std::chrono::steady_clock::time_point previousReadTime;
+  uint64_t previousCommandsExecuted;
+
+  CsoundBindingCounters() : previousReadTime(std::chrono::steady_clock::now()), previousCommandsExecuted(0) {
+    for (int i = 0; i < CsoundBindingCounterCount; i++) {
+      values[i].store(0, std::memory_order_relaxed);
+    }
+  }
+
+  void add(CsoundBindingCounter counter, uint64_t amount) {
+    values[counter].fetch_add(amount, std::memory_order_relaxed);
+  }
+  void subtract(CsoundBindingCounter counter, uint64_t amount) {
+    values[counter].fetch_sub(amount, std::memory_order_relaxed);
+  }
+
+  // Peak depth counters immediately follow depth counters.
+  void didEnqueue(CsoundBindingCounter depthCounter, size_t byteCount) {
+    uint64_t depth = values[depthCounter].fetch_add(1, std::memory_order_relaxed) + 1;
+    std::atomic<uint64_t> &peakDepth = values[depthCounter + 1];
+    uint64_t previousPeakDepth = peakDepth.load(std::memory_order_relaxed);
+    while (depth > previousPeakDepth && !peakDepth.compare_exchange_weak(previousPeakDepth, depth, std::memory_order_relaxed)) {}
+    add(CsoundBindingCounterQueuedBytes, byteCount);
+  }
+  void didDequeue(CsoundBindingCounter depthCounter, size_t byteCount) {
+    subtract(depthCounter, 1);
+    subtract(CsoundBindingCounterQueuedBytes, byteCount);
+  }
+
+  v8::Local<v8::Float64Array> newFloat64Array() {
+    v8::Local<v8::Float64Array> array = v8::Float64Array::New(v8::ArrayBuffer::New(v8::Isolate::GetCurrent(), sizeof(double) * CsoundBindingCounterCount), 0, CsoundBindingCounterCount);
+    Nan::TypedArrayContents<double> contents(array);
+    for (int i = 0; i < CsoundBindingCounterCount; i++) {
+      (*contents)[i] = values[i].load(std::memory_order_relaxed);
+    }
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    double seconds = std::chrono::duration<double>(now - previousReadTime).count();
+    uint64_t commandsExecuted = values[CsoundBindingCounterCommandsExecuted].load(std::memory_order_relaxed);
+    if (seconds > 0)
+      (*contents)[CsoundBindingCounterCommandsPerSecond] = (commandsExecuted - previousCommandsExecuted) / seconds;
+    previousReadTime = now;
+    previousCommandsExecuted = commandsExecuted;
+    return array;
+  }
+};
 
 // CsoundCallback is a subclass of Nan::Callback
 // <https://github.com/nodejs/nan/blob/master/doc/callback.md> to make it easier
@@ -15,28 +120,59 @@
 // method CsoundCallback::asyncCallback runs after a call to uv_async_send, the
 // CsoundCallback instance pops arguments off its queue into arrays of V8
 // values, which are then passed to a JavaScript function by
-// Nan::Callback::Call(). Using a lock-free queue is from csound.node by Michael
-// Gogins <https://github.com/gogins/csound-extended/tree/develop/csound.node>.
+// Nan::Callback::Call(). Argument classes also have a method T::byteCount that
+// returns the number of bytes allocated for the arguments, which is added to
+// the CsoundBindingCounters of an instance of Csound. Using a lock-free queue
+// is from csound.node by Michael Gogins
+// <https://github.com/gogins/csound-extended/tree/develop/csound.node>.
 template <typename T>
 struct CsoundCallback : public Nan::Callback {
   uv_async_t handle;
   boost::lockfree::queue<T> argumentsQueue;
+  CsoundBindingCounters *counters;
+  CsoundBindingCounter depthCounter;
 
   static void asyncCallback(uv_async_t *handle) {
     ((CsoundCallback *)handle->data)->executeCalls();
   }
 
-  CsoundCallback(const v8::Local<v8::Function> &function) : Nan::Callback(function), argumentsQueue(0) {
+  static void closeCallback(uv_handle_t *handle) {
+    delete (CsoundCallback *)handle->data;
+  }
+
+  CsoundCallback(const v8::Local<v8::Function> &function, CsoundBindingCounters *counters = NULL, CsoundBindingCounter depthCounter = CsoundBindingCounterCount) : Nan::Callback(function), argumentsQueue(0), counters(counters), depthCounter(depthCounter) {
     assert(uv_async_init(uv_default_loop(), &handle, asyncCallback) == 0);
     handle.data = this;
   }
 
+  // Use this instead of delete so that libuv stops using the async handle
+  // before this object is freed.
+  void close() {
+    uv_close((uv_handle_t *)&handle, closeCallback);
+  }
+
+  // Called on any thread to queue arguments and wake the main thread.
+  void push(const T &arguments) {
+    if (counters) {
+      size_t byteCount = arguments.byteCount();
+      counters->add(CsoundBindingCounterAllocatedBytes, byteCount);
+      counters->didEnqueue(depthCounter, byteCount);
+      counters->add(CsoundBindingCounterAsyncSends, 1);
+    }
+    argumentsQueue.push(arguments);
+    uv_async_send(&handle);
+  }
+
   void executeCalls() {
     Nan::HandleScope scope;
     Nan::AsyncResource resource("csound-api:callback");
 
     T arguments;
     while (argumentsQueue.pop(arguments)) {
+      if (counters) {
+        counters->didDequeue(depthCounter, arguments.byteCount());
+        counters->add(CsoundBindingCounterCallbackCalls, 1);
+      }
       v8::Local<v8::Value> argv[T::argc];
       arguments.getArgv(argv);
       Call(T::argc, argv, &resource);
@@ -64,6 +200,10 @@ struct CsoundFileOpenCallbackArguments {
     argv[3] = Nan::New((bool)isTemporary);
   }
 
+  size_t byteCount() const {
+    return strlen(path) + 1;
+  }
+
   void wereSent() {
     free(path);
   }
@@ -96,15 +236,72 @@ struct CsoundMessageCallbackArguments {
     argv[1] = Nan::New(message).ToLocalChecked();
   }
 
+  size_t byteCount() const {
+    return strlen(message) + 1;
+  }
+
   void wereSent() {
     free(message);
   }
 };
 
+// Csound uses double-precision samples when it’s compiled with USE_DOUBLE, and
+// single-precision samples otherwise. MYFLTArray is the type of typed array
+// that can view Csound’s samples without conversion.
+#ifdef USE_DOUBLE
+typedef v8::Float64Array MYFLTArray;
+#  define MYFLT_ARRAY_NAME "Float64Array"
+#else
+typedef v8::Float32Array MYFLTArray;
+#  define MYFLT_ARRAY_NAME "Float32Array"
+#endif
+
+static bool isMYFLTArray(v8::Local<v8::Value> value) {
+#ifdef USE_DOUBLE
+  return value->IsFloat64Array();
+#else
+  return value->IsFloat32Array();
+#endif
+}
+
+// Helper function to create an ArrayBuffer that views memory the ArrayBuffer
+// doesn’t own. The memory must remain valid until the ArrayBuffer is detached.
+static v8::Local<v8::ArrayBuffer> newArrayBufferWithExternalData(void *data, size_t byteLength) {
+#if NODE_MAJOR_VERSION >= 14
+  return v8::ArrayBuffer::New(v8::Isolate::GetCurrent(), v8::ArrayBuffer::NewBackingStore(data, byteLength, v8::BackingStore::EmptyDeleter, NULL));
+#else
+  return v8::ArrayBuffer::New(v8::Isolate::GetCurrent(), data, byteLength);
+#endif
+}
+
+// Helper function to create an ArrayBuffer that takes ownership of memory
+// allocated using malloc.
+static v8::Local<v8::ArrayBuffer> newArrayBufferWithMallocedData(void *data, size_t byteLength) {
+#if NODE_MAJOR_VERSION >= 14
+  return v8::ArrayBuffer::New(v8::Isolate::GetCurrent(), v8::ArrayBuffer::NewBackingStore(data, byteLength, [](void *data, size_t length, void *deleterData) { free(data); }, NULL));
+#else
+  return v8::ArrayBuffer::New(v8::Isolate::GetCurrent(), data, byteLength, v8::ArrayBufferCreationMode::kInternalized);
+#endif
+}
+
+static void detachArrayBuffer(v8::Local<v8::ArrayBuffer> arrayBuffer) {
+#if V8_MAJOR_VERSION >= 11
+  arrayBuffer->Detach(v8::Local<v8::Value>()).Check();
+#else
+  arrayBuffer->Detach();
+#endif
+}
+
 static Nan::Persistent<v8::Function> WINDATProxyConstructor;
 
 struct WINDATWrapper : public Nan::ObjectWrap {
   WINDAT data;
+  // A typed array that owns data.fdata.
+  Nan::Persistent<MYFLTArray> fdataArray;
+
+  ~WINDATWrapper() {
+    fdataArray.Reset();
+  }
 
   static NAN_METHOD(New) {
     (new WINDATWrapper())->Wrap(info.This());
@@ -122,12 +319,7 @@ struct WINDATWrapper : public Nan::ObjectWrap {
   static NAN_GETTER(oabsmax)  { info.GetReturnValue().Set(Nan::New(dataFromPropertyCallbackInfo(info).oabsmax)); }
 
   static NAN_GETTER(fdata) {
-    WINDATWrapper *wrapper = WINDATWrapper::Unwrap<WINDATWrapper>(info.This());
-    v8::Local<v8::Array> fdata = Nan::New<v8::Array>(wrapper->data.npts);
-    for (int32 i = 0; i < wrapper->data.npts; i++) {
-      Nan::Set(fdata, i, Nan::New(wrapper->data.fdata[i]));
-    }
-    info.GetReturnValue().Set(fdata);
+    info.GetReturnValue().Set(Nan::New(WINDATWrapper::Unwrap<WINDATWrapper>(info.This())->fdataArray));
   }
 };
 
@@ -141,30 +333,41 @@ struct CsoundGraphCallbackArguments {
     return arguments;
   }
 
+  // This transfers ownership of data.fdata to a typed array.
   void getArgv(v8::Local<v8::Value> *argv) const {
     v8::Local<v8::Object> proxy = Nan::NewInstance(Nan::New(WINDATProxyConstructor)).ToLocalChecked();
-    WINDATWrapper::Unwrap<WINDATWrapper>(proxy)->data = data;
+    WINDATWrapper *wrapper = WINDATWrapper::Unwrap<WINDATWrapper>(proxy);
+    wrapper->data = data;
+    size_t length = data.npts > 0 ? data.npts : 0;
+    wrapper->fdataArray.Reset(MYFLTArray::New(newArrayBufferWithMallocedData(data.fdata, sizeof(MYFLT) * length), 0, length));
     argv[0] = proxy;
   }
 
   void setData(WINDAT *data) {
     this->data = boost::initialized_value;
-    this->data.windid = data->windid;
-    this->data.fdata = (MYFLT *)malloc(sizeof(MYFLT) * data->npts);
-    for (int32 i = 0; i < data->npts; i++) {
-      this->data.fdata[i] = data->fdata[i];
-    }
-    this->data.npts = data->npts;
-    strcpy(this->data.caption, data->caption);
-    this->data.polarity = data->polarity;
-    this->data.max = data->max;
-    this->data.min = data->min;
-    this->data.oabsmax = data->oabsmax;
+    this->data.fdata = (MYFLT *)malloc(sizeof(MYFLT) * std::max(data->npts, (int32)1));
+    copyWindowData(this->data, data);
   }
 
-  void wereSent() {
-    free(this->data.fdata);
+  // Copy everything but the fdata pointer itself; destination.fdata must have
+  // room for source->npts values.
+  static void copyWindowData(WINDAT &destination, const WINDAT *source) {
+    destination.windid = source->windid;
+    if (source->npts > 0)
+      memcpy(destination.fdata, source->fdata, sizeof(MYFLT) * source->npts);
+    destination.npts = source->npts;
+    strcpy(destination.caption, source->caption);
+    destination.polarity = source->polarity;
+    destination.max = source->max;
+    destination.min = source->min;
+    destination.oabsmax = source->oabsmax;
+  }
+
+  size_t byteCount() const {
+    return sizeof(MYFLT) * std::max(data.npts, (int32)1);
   }
+
+  void wereSent() {}
 };
 
 struct CsoundMakeGraphCallbackArguments : public CsoundGraphCallbackArguments {
@@ -183,18 +386,115 @@ struct CsoundMakeGraphCallbackArguments : public CsoundGraphCallbackArguments {
     argv[1] = Nan::New(name).ToLocalChecked();
   }
 
+  size_t byteCount() const {
+    return CsoundGraphCallbackArguments::byteCount() + strlen(name) + 1;
+  }
+
   void wereSent() {
     free(name);
     CsoundGraphCallbackArguments::wereSent();
   }
 };
 
+// CsoundCoalescingGraphCallback is an alternative to
+// CsoundCallback<CsoundGraphCallbackArguments> that keeps only the most recent
+// frame of each graph (identified by windid). While a frame is waiting to be
+// passed to JavaScript, newer frames of the same graph overwrite it in place.
+// Each graph keeps its frame buffer after the frame is passed, so after the
+// first frame of a graph, adding frames doesn’t allocate memory on the
+// performance thread. Frames are copied for JavaScript on the main thread.
+struct CsoundCoalescingGraphCallback {
+  struct Frame {
+    WINDAT data;
+    int32 capacity;
+    bool isPending;
+  };
+
+  uv_async_t handle;
+  Nan::Callback callback;
+  std::mutex mutex;
+  std::map<uintptr_t, Frame> frames;
+  std::vector<uintptr_t> pendingWindowIDs;
+  std::vector<uintptr_t> sentWindowIDs;
+
+  static void asyncCallback(uv_async_t *handle) {
+    ((CsoundCoalescingGraphCallback *)handle->data)->executeCalls();
+  }
+
+  static void closeCallback(uv_handle_t *handle) {
+    delete (CsoundCoalescingGraphCallback *)handle->data;
+  }
+
+  CsoundCoalescingGraphCallback(const v8::Local<v8::Function> &function) : callback(function) {
+    assert(uv_async_init(uv_default_loop(), &handle, asyncCallback) == 0);
+    handle.data = this;
+  }
+  ~CsoundCoalescingGraphCallback() {
+    for (auto &entry : frames) {
+      free(entry.second.data.fdata);
+    }
+  }
+
+  // Use this instead of delete so that libuv stops using the async handle
+  // before this object is freed.
+  void close() {
+    uv_close((uv_handle_t *)&handle, closeCallback);
+  }
+
+  void addFrame(WINDAT *data) {
+    bool shouldSend;
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      shouldSend = pendingWindowIDs.empty();
+      // A new Frame is value-initialized, so its data is zeroed.
+      Frame &frame = frames[data->windid];
+      if (frame.capacity < data->npts) {
+        frame.data.fdata = (MYFLT *)realloc(frame.data.fdata, sizeof(MYFLT) * data->npts);
+        frame.capacity = data->npts;
+      }
+      CsoundGraphCallbackArguments::copyWindowData(frame.data, data);
+      if (!frame.isPending) {
+        frame.isPending = true;
+        pendingWindowIDs.push_back(data->windid);
+      }
+    }
+    if (shouldSend)
+      uv_async_send(&handle);
+  }
+
+  void executeCalls() {
+    std::vector<CsoundGraphCallbackArguments> argumentsList;
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      // Swapping keeps the capacity of both vectors.
+      sentWindowIDs.swap(pendingWindowIDs);
+      for (uintptr_t windowID : sentWindowIDs) {
+        Frame &frame = frames[windowID];
+        frame.isPending = false;
+        argumentsList.push_back(CsoundGraphCallbackArguments::create(&frame.data));
+      }
+    }
+    sentWindowIDs.clear();
+
+    Nan::HandleScope scope;
+    Nan::AsyncResource resource("csound-api:callback");
+
+    for (const CsoundGraphCallbackArguments &arguments : argumentsList) {
+      v8::Local<v8::Value> argv[CsoundGraphCallbackArguments::argc];
+      arguments.getArgv(argv);
+      callback.Call(CsoundGraphCallbackArguments::argc, argv, &resource);
+    }
+  }
+};
+
 // This is an abstract class that CSOUNDWrapper uses to handle calls to
 //   - csoundCompileOrc
 //   - csoundStop
 //   - csoundReadScore
 //   - csoundScoreEvent
 //   - csoundInputMessage
+//   - csoundSetAudioChannel
+//   - csoundTableCopyIn
 // When a Csound instance is not performing, these functions can be called on
 // the main thread, and this is what CsoundSynchronousEventHandler does. When a
 // Csound instance is performing on a background thread, these functions must be
@@ -208,13 +508,34 @@ struct CsoundEventHandler {
   virtual void handleStop(CSOUND *Csound) = 0;
   virtual void handleInputMessage(CSOUND *Csound, char *scoreStatement) = 0;
   virtual int handleReadScore(CSOUND *Csound, char *score) = 0;
-  virtual int handleScoreEvent(CSOUND *Csound, char eventType, MYFLT *parameterFieldValues, long parameterFieldCount) = 0;
+  // Arguments passed to handlers are owned by the caller. For
+  // handleScoreEvents, event i has the type eventTypes[i] and the parameter
+  // field values from parameterFieldValues[parameterFieldOffsets[i]] up to (but
+  // not including) parameterFieldValues[parameterFieldOffsets[i + 1]].
+  virtual int handleScoreEvent(CSOUND *Csound, char eventType, const MYFLT *parameterFieldValues, long parameterFieldCount) = 0;
+  virtual int handleScoreEvents(CSOUND *Csound, const char *eventTypes, const MYFLT *parameterFieldValues, const int32_t *parameterFieldOffsets, long eventCount) = 0;
+  virtual void handleSetAudioChannel(CSOUND *Csound, char *name, MYFLT *samples) = 0;
+  // For handleTableCopyIn, values has length elements.
+  virtual void handleTableCopyIn(CSOUND *Csound, int tableNumber, MYFLT *values, int length) = 0;
 
   virtual bool CsoundDidPerformKsmps(CSOUND *Csound) {
     return false;
   }
 };
 
+// Helper function to send a batch of score events to Csound. This returns
+// CSOUND_SUCCESS, or the status of the first score event that failed.
+static int performScoreEvents(CSOUND *Csound, const char *eventTypes, const MYFLT *parameterFieldValues, const int32_t *parameterFieldOffsets, long eventCount) {
+  int status = CSOUND_SUCCESS;
+  for (long i = 0; i < eventCount; i++) {
+    int32_t offset = parameterFieldOffsets[i];
+    int eventStatus = csoundScoreEvent(Csound, eventTypes[i], parameterFieldValues + offset, parameterFieldOffsets[i + 1] - offset);
+    if (status == CSOUND_SUCCESS)
+      status = eventStatus;
+  }
+  return status;
+}
+
 struct CsoundSynchronousEventHandler : public CsoundEventHandler {
   int handleCompileOrc(CSOUND *Csound, char *orchestra) {
     return csoundCompileOrc(Csound, orchestra);
@@ -228,476 +549,3389 @@ struct CsoundSynchronousEventHandler : public CsoundEventHandler {
   int handleReadScore(CSOUND *Csound, char *score) {
     return csoundReadScore(Csound, score);
   }
-  int handleScoreEvent(CSOUND *Csound, char eventType, MYFLT *parameterFieldValues, long parameterFieldCount) {
-    int status = csoundScoreEvent(Csound, eventType, parameterFieldValues, parameterFieldCount);
-    if (parameterFieldValues)
-      free(parameterFieldValues);
-    return status;
+  int handleScoreEvent(CSOUND *Csound, char eventType, const MYFLT *parameterFieldValues, long parameterFieldCount) {
+    return csoundScoreEvent(Csound, eventType, parameterFieldValues, parameterFieldCount);
+  }
+  int handleScoreEvents(CSOUND *Csound, const char *eventTypes, const MYFLT *parameterFieldValues, const int32_t *parameterFieldOffsets, long eventCount) {
+    return performScoreEvents(Csound, eventTypes, parameterFieldValues, parameterFieldOffsets, eventCount);
+  }
+  void handleSetAudioChannel(CSOUND *Csound, char *name, MYFLT *samples) {
+    csoundSetAudioChannel(Csound, name, samples);
+  }
+  void handleTableCopyIn(CSOUND *Csound, int tableNumber, MYFLT *values, int length) {
+    csoundTableCopyIn(Csound, tableNumber, values);
   }
 };
 
-// CSOUNDWrapper instances perform tasks related to callbacks. They also store
-// V8 values passed as host data from JavaScript.
-static Nan::Persistent<v8::Function> CSOUNDProxyConstructor;
-struct CSOUNDWrapper : public Nan::ObjectWrap {
-  CSOUND *Csound;
-  Nan::Persistent<v8::Value, Nan::CopyablePersistentTraits<v8::Value>> hostData;
-  CsoundEventHandler *eventHandler;
-
-  CsoundCallback<CsoundFileOpenCallbackArguments> *CsoundFileOpenCallbackObject;
-
-  CsoundCallback<CsoundMessageCallbackArguments> *CsoundMessageCallbackObject;
-
-  CsoundCallback<CsoundMakeGraphCallbackArguments> *CsoundMakeGraphCallbackObject;
-  CsoundCallback<CsoundGraphCallbackArguments> *CsoundDrawGraphCallbackObject;
-  CsoundCallback<CsoundGraphCallbackArguments> *CsoundKillGraphCallbackObject;
+enum CsoundEventType {
+  CsoundEventTypeCompileOrc,
+  CsoundEventTypeReadScore,
+  CsoundEventTypeScoreEvent,
+  CsoundEventTypeScoreEvents,
+  CsoundEventTypeInputMessage,
+  CsoundEventTypeSetAudioChannel,
+  CsoundEventTypeTableCopyIn
+};
 
-  // Require Csound 6.04 or later to use debugger functions.
-#define CSOUND_6_04_OR_LATER CS_VERSION >= 6 && CS_SUBVER >= 4
-#if CSOUND_6_04_OR_LATER
-  Nan::Callback *CsoundBreakpointCallbackObject;
-#endif
+// A CsoundEventCommand points to a payload (strings and parameter field values)
+// that the command doesn’t own. Payloads are either in a
+// CsoundEventPayloadArena, in which case isPayloadInArena is true and
+// payloadArenaSize is the number of bytes reserved in the arena (which may be
+// 0 for an empty payload), or allocated using malloc. Either way,
+// payloadByteCount is the number of bytes the payload occupies.
+struct CsoundEventCommand {
+  CsoundEventType type;
+  char *code;
+  char scoreEventType;
+  MYFLT *parameterFieldValues;
+  long parameterFieldCount;
+  int tableNumber;
+  int32_t *parameterFieldOffsets;
+  void *payload;
+  bool isPayloadInArena;
+  size_t payloadArenaSize;
+  size_t payloadByteCount;
+
+  void execute(CSOUND *Csound) {
+    switch (type) {
+      case CsoundEventTypeCompileOrc:
+        csoundCompileOrc(Csound, code);
+        break;
+      case CsoundEventTypeReadScore:
+        csoundReadScore(Csound, code);
+        break;
+      case CsoundEventTypeScoreEvent:
+        csoundScoreEvent(Csound, scoreEventType, parameterFieldValues, parameterFieldCount);
+        break;
+      case CsoundEventTypeScoreEvents:
+        performScoreEvents(Csound, code, parameterFieldValues, parameterFieldOffsets, parameterFieldCount);
+        break;
+      case CsoundEventTypeInputMessage:
+        csoundInputMessage(Csound, code);
+        break;
+      case CsoundEventTypeSetAudioChannel:
+        csoundSetAudioChannel(Csound, code, parameterFieldValues);
+        break;
+      case CsoundEventTypeTableCopyIn: {
+        // The function table may have been replaced since the command was
+        // queued, so copy no more than parameterFieldCount values.
+        MYFLT *table;
+        int length = csoundGetTable(Csound, &table, tableNumber);
+        if (length > 0)
+          memcpy(table, parameterFieldValues, sizeof(MYFLT) * std::min((long)length, parameterFieldCount));
+        break;
+      }
+    }
+  }
+};
 
-  static NAN_METHOD(New) {
-    (new CSOUNDWrapper())->Wrap(info.This());
-    info.GetReturnValue().Set(info.This());
+// CsoundEventPayloadArena is a ring buffer of bytes for command payloads. The
+// main thread reserves bytes and the performance thread releases them in the
+// same order, so neither thread allocates or frees memory once the arena
+// exists.
+struct CsoundEventPayloadArena {
+  static const size_t alignment = 16;
+
+  char *bytes;
+  size_t capacity;
+  std::atomic<size_t> reservedByteCount;
+  std::atomic<size_t> releasedByteCount;
+
+  CsoundEventPayloadArena(size_t capacity) : bytes((char *)malloc(capacity)), capacity(capacity), reservedByteCount(0), releasedByteCount(0) {}
+  ~CsoundEventPayloadArena() {
+    free(bytes);
   }
 
-  CSOUNDWrapper() {
-    eventHandler = new CsoundSynchronousEventHandler();
+  // Called on the main thread. If there’s room in the arena, this returns a
+  // pointer to at least size bytes and sets reservedSize to the number of bytes
+  // to release when the payload is no longer needed. Otherwise, this returns
+  // NULL.
+  void *reserve(size_t size, size_t &reservedSize) {
+    size = (size + alignment - 1) & ~(alignment - 1);
+    size_t reservedCount = reservedByteCount.load(std::memory_order_relaxed);
+    size_t freeCount = capacity - (reservedCount - releasedByteCount.load(std::memory_order_acquire));
+    size_t offset = reservedCount % capacity;
+    // Payloads are contiguous, so skip the bytes at the end of the arena if
+    // the payload doesn’t fit there.
+    size_t padding = offset + size > capacity ? capacity - offset : 0;
+    reservedSize = padding + size;
+    if (reservedSize > freeCount)
+      return NULL;
+    reservedByteCount.store(reservedCount + reservedSize, std::memory_order_relaxed);
+    return bytes + (padding ? 0 : offset);
   }
-  ~CSOUNDWrapper() {
-    delete eventHandler;
+
+  // Called on the performance thread.
+  void release(size_t reservedSize) {
+    releasedByteCount.store(releasedByteCount.load(std::memory_order_relaxed) + reservedSize, std::memory_order_release);
   }
 };
 
-// The CSOUND_CALLBACK_METHOD macro associates a Csound callback function with a
-// CsoundCallback instance using an appropriate argument type. For example,
-// CSOUND_CALLBACK_METHOD(Message) associates csoundSetMessageCallback with
-// CsoundCallback<CsoundMessageCallbackArguments>;
-// CSOUND_CALLBACK_METHOD(MakeGraph) associates csoundSetMakeGraphCallback with
-// CsoundCallback<CsoundMakeGraphCallbackArguments>; and so on.
-#define CSOUND_CALLBACK_METHOD_1(methodNameStem) CSOUND_CALLBACK_METHOD_2(methodNameStem, methodNameStem)
-#define CSOUND_CALLBACK_METHOD_2(methodNameStem, argumentsNameStem) \
-NAN_METHOD(Set ## methodNameStem ## Callback) { \
-  CSOUNDWrapper *wrapper = Nan::ObjectWrap::Unwrap<CSOUNDWrapper>(info[0].As<v8::Object>()); \
-  v8::Local<v8::Value> value = info[1]; \
-  if (value->IsFunction()) { \
-    wrapper->Csound ## methodNameStem ## CallbackObject = new CsoundCallback<Csound ## argumentsNameStem ## CallbackArguments>(value.As<v8::Function>()); \
-    csoundSet ## methodNameStem ## Callback(wrapper->Csound, Csound ## methodNameStem ## Callback); \
-  } else if (wrapper->Csound ## methodNameStem ## CallbackObject) { \
-    delete wrapper->Csound ## methodNameStem ## CallbackObject; \
-    wrapper->Csound ## methodNameStem ## CallbackObject = NULL; \
-    csoundSet ## methodNameStem ## Callback(wrapper->Csound, NULL); \
-  } \
-}
-#ifndef _MSC_VER
-#  define CSOUND_CALLBACK_METHOD(...) BOOST_PP_OVERLOAD(CSOUND_CALLBACK_METHOD_,__VA_ARGS__)(__VA_ARGS__)
-#else
-#  define CSOUND_CALLBACK_METHOD(...) BOOST_PP_CAT(BOOST_PP_OVERLOAD(CSOUND_CALLBACK_METHOD_,__VA_ARGS__)(__VA_ARGS__),BOOST_PP_EMPTY())
-#endif
-
-// Helper function to set return values to either a string or null.
-static void setReturnValueWithCString(Nan::ReturnValue<v8::Value> returnValue, const char *string) {
-  if (string)
-    returnValue.Set(Nan::New(string).ToLocalChecked());
-  else
-    returnValue.SetNull();
-}
-
-// By default, the Csound API establishes a signal handler that can prevent
-// Node.js from terminating immediately in response to a SIGINT, especially when
-// Csound instances are performing in the background
-// (https://github.com/nwhetsell/csound-api/issues/9). As a workaround, keep
-// track of how many Csound instances are performing in the background, and save
-// a signal to be re-raised after ending these performances. This is based on
-// https://www.gnu.org/software/libc/manual/html_node/Remembering-a-Signal.html.
+// CsoundAsynchronousEventHandler queues commands on a preallocated
+// single-producer, single-consumer ring, and copies payloads into an arena.
+// Payloads that don’t fit in the arena are allocated using malloc on the main
+// thread, and then returned to the main thread to be freed so that the
+// performance thread never frees memory. When the command ring is full,
+// commands are dropped and functions with a status return CSOUND_MEMORY.
+struct CsoundAsynchronousEventHandler : public CsoundEventHandler {
+  static const size_t commandCapacity = 1024;
+  static const size_t payloadArenaCapacity = 1 << 20;
 
-static volatile sig_atomic_t performingCsoundInstanceCount = 0;
-static volatile sig_atomic_t raisedSignal = 0;
+  boost::lockfree::spsc_queue<CsoundEventCommand> commandQueue;
+  boost::lockfree::spsc_queue<void *> freedPayloadQueue;
+  CsoundEventPayloadArena payloadArena;
+  std::atomic<bool> stopRequested;
+  CsoundBindingCounters *counters;
 
-#define SIGNAL_HANDLER_FUNCTION(SIGNAL) \
-  static void handle ## SIGNAL(int sig) { \
-    if (performingCsoundInstanceCount == 0) { \
-      signal(sig, SIG_DFL); \
-      raise(sig); \
-    } else { \
-      raisedSignal = sig; \
-    } \
+  CsoundAsynchronousEventHandler(CsoundBindingCounters *counters) : commandQueue(commandCapacity), freedPayloadQueue(commandCapacity), payloadArena(payloadArenaCapacity), stopRequested(false), counters(counters) {
+    counters->add(CsoundBindingCounterAllocatedBytes, payloadArenaCapacity);
   }
-SIGNAL_HANDLER_FUNCTION(SIGINT)
-SIGNAL_HANDLER_FUNCTION(SIGTERM)
-
-static int initializeCsound(int flags) {
-  int result = csoundInitialize(flags | CSOUNDINIT_NO_SIGNAL_HANDLER);
-
-  // csoundInitialize returns 0 when initialization is successful, which should
-  // happen only once.
-  if (result == 0 && !(flags & CSOUNDINIT_NO_SIGNAL_HANDLER)) {
-    signal(SIGINT, handleSIGINT);
-    signal(SIGTERM, handleSIGTERM);
+  ~CsoundAsynchronousEventHandler() {
+    freeReturnedPayloads();
+    CsoundEventCommand command;
+    while (commandQueue.pop(command)) {
+      counters->didDequeue(CsoundBindingCounterCommandQueueDepth, command.payloadByteCount);
+      if (!command.isPayloadInArena)
+        free(command.payload);
+    }
   }
 
-  return result;
-}
-
-static NAN_METHOD(Initialize) {
-  info.GetReturnValue().Set(initializeCsound(Nan::To<int32_t>(info[0]).FromJust()));
-}
-
-struct CsoundInitializationOption {
-  static NAN_GETTER(NoSignalHandlers) { info.GetReturnValue().Set(CSOUNDINIT_NO_SIGNAL_HANDLER); }
-  static NAN_GETTER(NoExitFunction)   { info.GetReturnValue().Set(CSOUNDINIT_NO_ATEXIT); }
-};
+  void freeReturnedPayloads() {
+    void *payload;
+    while (freedPayloadQueue.pop(payload)) {
+      free(payload);
+    }
+  }
 
-static NAN_METHOD(Create) {
-  initializeCsound(0);
+  // Called on the main thread to reserve memory for a command’s payload. This
+  // returns NULL if the command ring is full.
+  char *allocatePayload(CsoundEventCommand &command, size_t size) {
+    freeReturnedPayloads();
+    if (!commandQueue.write_available())
+      return NULL;
+    command.payload = payloadArena.reserve(size, command.payloadArenaSize);
+    command.isPayloadInArena = command.payload != NULL;
+    if (!command.isPayloadInArena) {
+      // Allocate at least 1 byte so that malloc doesn’t return NULL.
+      command.payload = malloc(std::max(size, (size_t)1));
+      command.payloadArenaSize = 0;
+      counters->add(CsoundBindingCounterAllocatedBytes, size);
+    }
+    command.payloadByteCount = size;
+    return (char *)command.payload;
+  }
 
-  v8::Local<v8::Object> proxy = Nan::NewInstance(Nan::New(CSOUNDProxyConstructor)).ToLocalChecked();
-  CSOUNDWrapper *wrapper = Nan::ObjectWrap::Unwrap<CSOUNDWrapper>(proxy);
-  CSOUND *Csound = csoundCreate(wrapper);
-  if (Csound) {
-    wrapper->Csound = Csound;
-    wrapper->hostData.Reset(info[0]);
-    info.GetReturnValue().Set(proxy);
-  } else {
-    info.GetReturnValue().SetNull();
+  void pushCommand(const CsoundEventCommand &command) {
+    counters->didEnqueue(CsoundBindingCounterCommandQueueDepth, command.payloadByteCount);
+    commandQueue.push(command);
   }
-}
 
-static CSOUND *CsoundFromFunctionCallbackInfo(Nan::NAN_METHOD_ARGS_TYPE info) {
-  return Nan::ObjectWrap::Unwrap<CSOUNDWrapper>(info[0].As<v8::Object>())->Csound;
-}
+  int enqueueCodeCommand(CsoundEventType type, const char *code) {
+    CsoundEventCommand command;
+    command.type = type;
+    size_t size = strlen(code) + 1;
+    command.code = allocatePayload(command, size);
+    if (!command.code)
+      return CSOUND_MEMORY;
+    memcpy(command.code, code, size);
+    pushCommand(command);
+    return CSOUND_SUCCESS;
+  }
 
-static NAN_METHOD(Destroy) {
-  csoundDestroy(CsoundFromFunctionCallbackInfo(info));
+  int handleCompileOrc(CSOUND *Csound, char *orchestra) {
+    return enqueueCodeCommand(CsoundEventTypeCompileOrc, orchestra);
+  }
+  void handleStop(CSOUND *Csound) {
+    stopRequested.store(true, std::memory_order_release);
+  }
+  void handleInputMessage(CSOUND *Csound, char *scoreStatement) {
+    enqueueCodeCommand(CsoundEventTypeInputMessage, scoreStatement);
+  }
+  int handleReadScore(CSOUND *Csound, char *score) {
+    return enqueueCodeCommand(CsoundEventTypeReadScore, score);
+  }
+  int handleScoreEvent(CSOUND *Csound, char eventType, const MYFLT *parameterFieldValues, long parameterFieldCount) {
+    CsoundEventCommand command;
+    command.type = CsoundEventTypeScoreEvent;
+    command.scoreEventType = eventType;
+    size_t size = sizeof(MYFLT) * parameterFieldCount;
+    command.parameterFieldValues = (MYFLT *)allocatePayload(command, size);
+    if (!command.parameterFieldValues)
+      return CSOUND_MEMORY;
+    if (size)
+      memcpy(command.parameterFieldValues, parameterFieldValues, size);
+    command.parameterFieldCount = parameterFieldCount;
+    pushCommand(command);
+    return CSOUND_SUCCESS;
+  }
+  int handleScoreEvents(CSOUND *Csound, const char *eventTypes, const MYFLT *parameterFieldValues, const int32_t *parameterFieldOffsets, long eventCount) {
+    // Copy the whole batch into one payload laid out as parameter field values,
+    // then offsets (rebased to start at 0), then event types.
+    int32_t firstOffset = parameterFieldOffsets[0];
+    size_t parameterFieldsSize = sizeof(MYFLT) * (parameterFieldOffsets[eventCount] - firstOffset);
+    size_t offsetsSize = sizeof(int32_t) * (eventCount + 1);
+    CsoundEventCommand command;
+    char *payload = allocatePayload(command, parameterFieldsSize + offsetsSize + eventCount);
+    if (!payload)
+      return CSOUND_MEMORY;
+    memcpy(payload, parameterFieldValues + firstOffset, parameterFieldsSize);
+    int32_t *offsets = (int32_t *)(payload + parameterFieldsSize);
+    for (long i = 0; i <= eventCount; i++) {
+      offsets[i] = parameterFieldOffsets[i] - firstOffset;
+    }
+    char *types = payload + parameterFieldsSize + offsetsSize;
+    memcpy(types, eventTypes, eventCount);
+
+    command.type = CsoundEventTypeScoreEvents;
+    command.code = types;
+    command.parameterFieldValues = (MYFLT *)payload;
+    command.parameterFieldOffsets = offsets;
+    command.parameterFieldCount = eventCount;
+    pushCommand(command);
+    return CSOUND_SUCCESS;
+  }
+  void handleSetAudioChannel(CSOUND *Csound, char *name, MYFLT *samples) {
+    size_t samplesSize = sizeof(MYFLT) * csoundGetKsmps(Csound);
+    size_t nameSize = strlen(name) + 1;
+    CsoundEventCommand command;
+    char *payload = allocatePayload(command, samplesSize + nameSize);
+    if (!payload)
+      return;
+    command.type = CsoundEventTypeSetAudioChannel;
+    command.parameterFieldValues = (MYFLT *)payload;
+    memcpy(command.parameterFieldValues, samples, samplesSize);
+    command.code = payload + samplesSize;
+    memcpy(command.code, name, nameSize);
+    pushCommand(command);
+  }
+  void handleTableCopyIn(CSOUND *Csound, int tableNumber, MYFLT *values, int length) {
+    size_t size = sizeof(MYFLT) * length;
+    CsoundEventCommand command;
+    command.parameterFieldValues = (MYFLT *)allocatePayload(command, size);
+    if (!command.parameterFieldValues)
+      return;
+    command.type = CsoundEventTypeTableCopyIn;
+    command.tableNumber = tableNumber;
+    command.parameterFieldCount = length;
+    memcpy(command.parameterFieldValues, values, size);
+    pushCommand(command);
+  }
+
+  bool CsoundDidPerformKsmps(CSOUND *Csound) {
+    CsoundEventCommand command;
+    while (commandQueue.pop(command)) {
+      counters->didDequeue(CsoundBindingCounterCommandQueueDepth, command.payloadByteCount);
+      counters->add(CsoundBindingCounterCommandsExecuted, 1);
+      command.execute(Csound);
+      if (command.isPayloadInArena)
+        payloadArena.release(command.payloadArenaSize);
+      else
+        freedPayloadQueue.push(command.payload);
+    }
+    return stopRequested.load(std::memory_order_acquire);
+  }
+};
+
+// CsoundMessageBatch is an alternative to
+// CsoundCallback<CsoundMessageCallbackArguments> that formats messages into a
+// preallocated buffer and passes all messages received since the last call to
+// one call of a JavaScript function. Messages are written to one of two buffers
+// while the main thread reads the other, and uv_async_send is called only when
+// a buffer goes from empty to non-empty. When a buffer is full, messages are
+// dropped and counted.
+struct CsoundMessageBatch {
+  struct Buffer {
+    char *text;
+    size_t textLength;
+    std::vector<int32_t> attributes;
+    std::vector<size_t> offsets;
+  };
+
+  uv_async_t handle;
+  Nan::Callback callback;
+  std::mutex mutex;
+  Buffer buffers[2];
+  Buffer *writeBuffer;
+  size_t maxTextLength;
+  size_t maxMessageCount;
+  uint32_t droppedMessageCount;
+
+  static void asyncCallback(uv_async_t *handle) {
+    ((CsoundMessageBatch *)handle->data)->executeCall();
+  }
+
+  static void closeCallback(uv_handle_t *handle) {
+    delete (CsoundMessageBatch *)handle->data;
+  }
+
+  CsoundMessageBatch(const v8::Local<v8::Function> &function, size_t maxMessageCount, size_t maxTextLength) : callback(function), writeBuffer(buffers), maxTextLength(maxTextLength), maxMessageCount(maxMessageCount), droppedMessageCount(0) {
+    for (Buffer &buffer : buffers) {
+      buffer.text = (char *)malloc(maxTextLength);
+      buffer.textLength = 0;
+      buffer.attributes.reserve(maxMessageCount);
+      buffer.offsets.reserve(maxMessageCount + 1);
+      buffer.offsets.push_back(0);
+    }
+    assert(uv_async_init(uv_default_loop(), &handle, asyncCallback) == 0);
+    handle.data = this;
+  }
+  ~CsoundMessageBatch() {
+    for (Buffer &buffer : buffers) {
+      free(buffer.text);
+    }
+  }
+
+  // Use this instead of delete so that libuv stops using the async handle
+  // before this object is freed.
+  void close() {
+    uv_close((uv_handle_t *)&handle, closeCallback);
+  }
+
+  void addMessage(int attributes, const char *format, va_list argumentList) {
+    bool shouldSend;
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      Buffer *buffer = writeBuffer;
+      size_t availableLength = maxTextLength - buffer->textLength;
+      if (buffer->attributes.size() == maxMessageCount || availableLength == 0) {
+        droppedMessageCount++;
+        return;
+      }
+      int length = vsnprintf(buffer->text + buffer->textLength, availableLength, format, argumentList);
+      if (length < 0) {
+        droppedMessageCount++;
+        return;
+      }
+      if ((size_t)length >= availableLength) {
+        // Drop messages that don’t fit, unless the buffer is empty; then,
+        // truncate the message.
+        if (!buffer->attributes.empty()) {
+          droppedMessageCount++;
+          return;
+        }
+        length = availableLength - 1;
+      }
+      buffer->textLength += length;
+      buffer->attributes.push_back(attributes);
+      buffer->offsets.push_back(buffer->textLength);
+      shouldSend = buffer->attributes.size() == 1;
+    }
+    if (shouldSend)
+      uv_async_send(&handle);
+  }
+
+  void executeCall() {
+    Buffer *buffer;
+    uint32_t droppedMessageCount;
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      buffer = writeBuffer;
+      writeBuffer = buffer == buffers ? buffers + 1 : buffers;
+      droppedMessageCount = this->droppedMessageCount;
+      this->droppedMessageCount = 0;
+    }
+
+    Nan::HandleScope scope;
+    Nan::AsyncResource resource("csound-api:callback");
+
+    uint32_t messageCount = buffer->attributes.size();
+    v8::Local<v8::Array> messages = Nan::New<v8::Array>(messageCount);
+    v8::Local<v8::Int32Array> attributes = v8::Int32Array::New(v8::ArrayBuffer::New(v8::Isolate::GetCurrent(), sizeof(int32_t) * messageCount), 0, messageCount);
+    Nan::TypedArrayContents<int32_t> attributesContents(attributes);
+    for (uint32_t i = 0; i < messageCount; i++) {
+      size_t offset = buffer->offsets[i];
+      Nan::Set(messages, i, Nan::New(buffer->text + offset, buffer->offsets[i + 1] - offset).ToLocalChecked());
+      (*attributesContents)[i] = buffer->attributes[i];
+    }
+    buffer->textLength = 0;
+    buffer->attributes.clear();
+    buffer->offsets.resize(1);
+
+    if (messageCount > 0 || droppedMessageCount > 0) {
+      const int argc = 3;
+      v8::Local<v8::Value> argv[argc] = {messages, attributes, Nan::New(droppedMessageCount)};
+      callback.Call(argc, argv, &resource);
+    }
+  }
+};
+
+// CsoundMessageFilter decides whether to pass a message to a message callback.
+// Message types are stored as bits of typeMask so that checking a type doesn’t
+// depend on the number of allowed types. Checking excluded prefixes and
+// substrings requires formatting the message, which is done in a stack buffer
+// (so messages longer than the buffer are checked only up to its length).
+struct CsoundMessageFilter {
+  static const size_t maxCheckedLength = 1024;
+
+  unsigned int typeMask;
+  std::vector<std::string> excludedPrefixes;
+  std::vector<std::string> excludedSubstrings;
+
+  CsoundMessageFilter() : typeMask(~0u) {}
+
+  static unsigned int bitForAttributes(int attributes) {
+    return 1u << ((attributes & CSOUNDMSG_TYPE_MASK) >> 12);
+  }
+
+  bool acceptsMessage(int attributes, const char *format, va_list argumentList) const {
+    if (!(typeMask & bitForAttributes(attributes)))
+      return false;
+    if (excludedPrefixes.empty() && excludedSubstrings.empty())
+      return true;
+
+    char message[maxCheckedLength];
+    va_list argumentListCopy;
+    va_copy(argumentListCopy, argumentList);
+    vsnprintf(message, maxCheckedLength, format, argumentListCopy);
+    va_end(argumentListCopy);
+    for (const std::string &prefix : excludedPrefixes) {
+      if (strncmp(message, prefix.c_str(), prefix.length()) == 0)
+        return false;
+    }
+    for (const std::string &substring : excludedSubstrings) {
+      if (strstr(message, substring.c_str()))
+        return false;
+    }
+    return true;
+  }
+
+  void setOptions(v8::Local<v8::Object> options) {
+    v8::Local<v8::Value> value = Nan::Get(options, Nan::New("messageTypes").ToLocalChecked()).ToLocalChecked();
+    if (value->IsArray()) {
+      v8::Local<v8::Array> messageTypes = value.As<v8::Array>();
+      typeMask = 0;
+      for (uint32_t i = 0; i < messageTypes->Length(); i++) {
+        typeMask |= bitForAttributes(Nan::To<int32_t>(Nan::Get(messageTypes, i).ToLocalChecked()).FromJust());
+      }
+    }
+    setStrings(excludedPrefixes, Nan::Get(options, Nan::New("excludedPrefixes").ToLocalChecked()).ToLocalChecked());
+    setStrings(excludedSubstrings, Nan::Get(options, Nan::New("excludedSubstrings").ToLocalChecked()).ToLocalChecked());
+  }
+
+  static void setStrings(std::vector<std::string> &strings, v8::Local<v8::Value> value) {
+    if (!value->IsArray())
+      return;
+    v8::Local<v8::Array> array = value.As<v8::Array>();
+    for (uint32_t i = 0; i < array->Length(); i++) {
+      std::string string(*Nan::Utf8String(Nan::Get(array, i).ToLocalChecked()));
+      if (!string.empty())
+        strings.push_back(string);
+    }
+  }
+};
+
+// Message filters are read on threads that call message callbacks while the
+// main thread may replace them, so a CsoundAtomicMessageFilter swaps pointers
+// to filters that don’t change once set. Threads count themselves as readers
+// before loading the pointer, and a replaced filter is deleted once no thread
+// is reading a filter. Filtering doesn’t block, so this wait is short.
+struct CsoundAtomicMessageFilter {
+  std::atomic<const CsoundMessageFilter *> filter;
+  std::atomic<uint32_t> readerCount;
+
+  CsoundAtomicMessageFilter() : filter(new CsoundMessageFilter()), readerCount(0) {}
+  ~CsoundAtomicMessageFilter() {
+    delete filter.load();
+  }
+
+  bool acceptsMessage(int attributes, const char *format, va_list argumentList) {
+    readerCount.fetch_add(1);
+    bool acceptsMessage = filter.load()->acceptsMessage(attributes, format, argumentList);
+    readerCount.fetch_sub(1);
+    return acceptsMessage;
+  }
+
+  // Pass a filter that’s completely set up; it must not change afterward.
+  void set(const CsoundMessageFilter *newFilter) {
+    const CsoundMessageFilter *replacedFilter = filter.exchange(newFilter);
+    while (readerCount.load() > 0) {
+      std::this_thread::yield();
+    }
+    delete replacedFilter;
+  }
+};
+
+// Csound reads and writes control channels atomically, and this code does the
+// same by treating channel pointers as pointers to atomic MYFLTs.
+static_assert(sizeof(std::atomic<MYFLT>) == sizeof(MYFLT), "std::atomic<MYFLT> must have the same size as MYFLT");
+
+// Helper function to get a control channel pointer. Unlike
+// csoundGetControlChannel and csoundSetControlChannel, this doesn’t check
+// whether a channel is for input or output.
+static std::atomic<MYFLT> *getControlChannelPointer(CSOUND *Csound, const char *name, int type) {
+  MYFLT *channel;
+  if (csoundGetChannelPtr(Csound, &channel, name, type) != CSOUND_SUCCESS)
+    return NULL;
+  return reinterpret_cast<std::atomic<MYFLT> *>(channel);
+}
+
+// Objects that store pointers from csoundGetChannelPtr register with a
+// CSOUNDWrapper, which calls invalidateChannelPointers before Csound frees its
+// channels.
+struct CsoundChannelPointerOwner {
+  virtual ~CsoundChannelPointerOwner() {};
+
+  virtual void invalidateChannelPointers() = 0;
+};
+
+// By default, the Csound API establishes a signal handler that can prevent
+// Node.js from terminating immediately in response to a SIGINT, especially when
+// Csound instances are performing in the background
+// (https://github.com/nwhetsell/csound-api/issues/9). As a workaround, keep
+// track of how many Csound instances are performing in the background, and save
+// a signal to be re-raised after ending these performances. This is based on
+// https://www.gnu.org/software/libc/manual/html_node/Remembering-a-Signal.html.
+
+static volatile sig_atomic_t performingCsoundInstanceCount = 0;
+static volatile sig_atomic_t raisedSignal = 0;
+
+// Audio streams move interleaved samples between a performance thread and
+// JavaScript through a preallocated single-producer, single-consumer ring.
+// Samples are stored in the ring as MYFLTs, and converted to or from the
+// stream’s sample format on the main thread.
+enum CsoundSampleFormat {
+  CsoundSampleFormatFloat32,
+  CsoundSampleFormatInt16,
+  CsoundSampleFormatFloat64
+};
+
+static size_t bytesPerSampleOfFormat(CsoundSampleFormat format) {
+  switch (format) {
+    case CsoundSampleFormatFloat32: return sizeof(float);
+    case CsoundSampleFormatInt16:   return sizeof(int16_t);
+    case CsoundSampleFormatFloat64: return sizeof(double);
+  }
+  return 0;
+}
+
+struct CsoundAudioStreamWrapper : public Nan::ObjectWrap {
+  CsoundSampleFormat format;
+  // In real-time mode, the performance thread never waits for JavaScript.
+  bool isRealtime;
+  MYFLT fullScalePeakAmplitude;
+  boost::lockfree::spsc_queue<MYFLT> *ring;
+  // The performance thread waits on this condition variable in offline mode.
+  std::mutex mutex;
+  std::condition_variable condition;
+  std::atomic<bool> isInterrupted;
+
+  CsoundAudioStreamWrapper() : format(CsoundSampleFormatFloat32), isRealtime(false), fullScalePeakAmplitude(1), ring(NULL), isInterrupted(false) {}
+  ~CsoundAudioStreamWrapper() {
+    delete ring;
+  }
+
+  // Helper function to set up a stream from the options passed to
+  // CreateOutputStream or CreateInputStream. This throws an exception and
+  // returns false if the options are invalid.
+  bool setUp(CSOUND *Csound, v8::Local<v8::Value> options, uint32_t channelCount, const char *functionName) {
+    fullScalePeakAmplitude = csoundGet0dBFS(Csound);
+    uint32_t frameCount = 8192;
+    if (options->IsObject()) {
+      v8::Local<v8::Object> optionsObject = options.As<v8::Object>();
+      v8::Local<v8::Value> value = Nan::Get(optionsObject, Nan::New("format").ToLocalChecked()).ToLocalChecked();
+      if (!value->IsUndefined()) {
+        std::string formatName(*Nan::Utf8String(value));
+        if (formatName == "float32") {
+          format = CsoundSampleFormatFloat32;
+        } else if (formatName == "int16") {
+          format = CsoundSampleFormatInt16;
+        } else if (formatName == "float64") {
+          format = CsoundSampleFormatFloat64;
+        } else {
+          Nan::ThrowTypeError((std::string("Format of ") + functionName + " must be 'float32', 'int16', or 'float64'.").c_str());
+          return false;
+        }
+      }
+      isRealtime = Nan::To<bool>(Nan::Get(optionsObject, Nan::New("realtime").ToLocalChecked()).ToLocalChecked()).FromJust();
+      value = Nan::Get(optionsObject, Nan::New("bufferFrames").ToLocalChecked()).ToLocalChecked();
+      if (!value->IsUndefined())
+        frameCount = std::max(Nan::To<uint32_t>(value).FromJust(), (uint32_t)csoundGetKsmps(Csound));
+    }
+    ring = new boost::lockfree::spsc_queue<MYFLT>((size_t)frameCount * channelCount);
+    return true;
+  }
+
+  MYFLT sampleFromBytes(const char *bytes) const {
+    switch (format) {
+      case CsoundSampleFormatFloat32: {
+        float sample;
+        memcpy(&sample, bytes, sizeof(float));
+        return sample;
+      }
+      case CsoundSampleFormatInt16: {
+        int16_t sample;
+        memcpy(&sample, bytes, sizeof(int16_t));
+        return fullScalePeakAmplitude * sample / 32768.0;
+      }
+      case CsoundSampleFormatFloat64: {
+        double sample;
+        memcpy(&sample, bytes, sizeof(double));
+        return sample;
+      }
+    }
+    return 0;
+  }
+
+  void sampleToBytes(MYFLT sample, char *bytes) const {
+    switch (format) {
+      case CsoundSampleFormatFloat32: {
+        float value = sample;
+        memcpy(bytes, &value, sizeof(float));
+        break;
+      }
+      case CsoundSampleFormatInt16: {
+        double scaledSample = std::min(std::max(sample / fullScalePeakAmplitude, (MYFLT)-1), (MYFLT)1) * 32767;
+        int16_t value = (int16_t)lrint(scaledSample);
+        memcpy(bytes, &value, sizeof(int16_t));
+        break;
+      }
+      case CsoundSampleFormatFloat64: {
+        double value = sample;
+        memcpy(bytes, &value, sizeof(double));
+        break;
+      }
+    }
+  }
+
+  // Called on the performance thread in offline mode. This returns false if the
+  // stream was interrupted before the condition was met.
+  template <typename Predicate>
+  bool waitUntil(Predicate predicate) {
+    if (predicate())
+      return true;
+    std::unique_lock<std::mutex> lock(mutex);
+    while (!predicate()) {
+      if (isInterrupted.load() || raisedSignal)
+        return false;
+      condition.wait_for(lock, std::chrono::milliseconds(10));
+    }
+    return true;
+  }
+
+  // Called on the main thread after reading from or writing to the ring.
+  void notifyPerformanceThread() {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+    }
+    condition.notify_one();
+  }
+
+  // Called on the main thread when a performance starts or stops, or when
+  // Csound is stopped.
+  virtual void CsoundWillPerform() {
+    isInterrupted.store(false);
+  }
+  virtual void CsoundDidStop() {
+    isInterrupted.store(true);
+    condition.notify_one();
+  }
+  virtual void CsoundDidFinishPerformance() {}
+};
+
+// CsoundOutputStreamWrapper copies Csound’s spout buffer into its ring after
+// each control period, and passes the samples to a JavaScript function as
+// Buffers. While the stream is paused, the ring fills up, and then the
+// performance thread either waits (in offline mode) or drops control periods
+// of samples and counts the dropped frames (in real-time mode). When the
+// performance finishes, the function is passed null.
+static Nan::Persistent<v8::Function> OutputStreamProxyConstructor;
+struct CsoundOutputStreamWrapper : public CsoundAudioStreamWrapper {
+  uv_async_t *handle;
+  Nan::Callback callback;
+  std::atomic<uint64_t> droppedFrameCounter;
+  uint32_t channelCount;
+  bool isPaused;
+  bool isFinished;
+  bool didEnd;
+  std::vector<MYFLT> samples;
+
+  static NAN_METHOD(New) {
+    (new CsoundOutputStreamWrapper())->Wrap(info.This());
+    info.GetReturnValue().Set(info.This());
+  }
+
+  static void asyncCallback(uv_async_t *handle) {
+    if (handle->data)
+      ((CsoundOutputStreamWrapper *)handle->data)->sendSamples();
+  }
+
+  CsoundOutputStreamWrapper() : droppedFrameCounter(0), channelCount(1), isPaused(false), isFinished(false), didEnd(false) {
+    handle = new uv_async_t;
+    assert(uv_async_init(uv_default_loop(), handle, asyncCallback) == 0);
+    handle->data = this;
+  }
+  ~CsoundOutputStreamWrapper() {
+    handle->data = NULL;
+    uv_close((uv_handle_t *)handle, [](uv_handle_t *handle) { delete (uv_async_t *)handle; });
+  }
+
+  // Called on the performance thread after each control period.
+  void CsoundDidPerformKsmps(CSOUND *Csound) {
+    uint32_t frameCount = csoundGetKsmps(Csound);
+    size_t sampleCount = (size_t)frameCount * channelCount;
+    bool hasSpace = isRealtime ? ring->write_available() >= sampleCount : waitUntil([&] { return ring->write_available() >= sampleCount; });
+    if (hasSpace) {
+      ring->push(csoundGetSpout(Csound), sampleCount);
+      uv_async_send(handle);
+    } else {
+      droppedFrameCounter.fetch_add(frameCount, std::memory_order_relaxed);
+    }
+  }
+
+  void CsoundWillPerform() {
+    CsoundAudioStreamWrapper::CsoundWillPerform();
+    isFinished = false;
+    didEnd = false;
+  }
+
+  void CsoundDidFinishPerformance() {
+    isFinished = true;
+    sendSamples();
+  }
+
+  // Called on the main thread.
+  void sendSamples() {
+    Nan::HandleScope scope;
+    Nan::AsyncResource resource("csound-api:callback");
+
+    if (isPaused)
+      return;
+
+    size_t sampleCount = ring->read_available();
+    if (sampleCount > 0) {
+      if (samples.size() < sampleCount)
+        samples.resize(sampleCount);
+      sampleCount = ring->pop(samples.data(), sampleCount);
+      notifyPerformanceThread();
+
+      size_t bytesPerSample = bytesPerSampleOfFormat(format);
+      char *bytes = (char *)malloc(bytesPerSample * sampleCount);
+      for (size_t i = 0; i < sampleCount; i++) {
+        sampleToBytes(samples[i], bytes + i * bytesPerSample);
+      }
+      v8::Local<v8::Value> argv[] = {Nan::NewBuffer(bytes, bytesPerSample * sampleCount).ToLocalChecked()};
+      callback.Call(1, argv, &resource);
+    }
+
+    if (isFinished && !didEnd && !isPaused && !ring->read_available()) {
+      didEnd = true;
+      v8::Local<v8::Value> argv[] = {Nan::Null()};
+      callback.Call(1, argv, &resource);
+    }
+  }
+
+  static NAN_METHOD(pause) {
+    Unwrap<CsoundOutputStreamWrapper>(info.This())->isPaused = true;
+  }
+
+  static NAN_METHOD(resume) {
+    CsoundOutputStreamWrapper *wrapper = Unwrap<CsoundOutputStreamWrapper>(info.This());
+    if (wrapper->isPaused) {
+      wrapper->isPaused = false;
+      wrapper->sendSamples();
+    }
+  }
+
+  static NAN_GETTER(droppedFrameCount) {
+    info.GetReturnValue().Set(Nan::New((double)Unwrap<CsoundOutputStreamWrapper>(info.This())->droppedFrameCounter.load()));
+  }
+};
+
+// CsoundInputStreamWrapper converts Buffers of interleaved samples written from
+// JavaScript, and copies them into Csound’s spin buffer before each control
+// period. When there aren’t enough samples for a control period, the
+// performance thread either waits (in offline mode) or fills the rest of the
+// spin buffer with zeros and counts the missing frames (in real-time mode).
+// After end() is called, the performance thread never waits.
+static Nan::Persistent<v8::Function> InputStreamProxyConstructor;
+struct CsoundInputStreamWrapper : public CsoundAudioStreamWrapper {
+  uv_async_t *handle;
+  std::atomic<uint64_t> underrunFrameCounter;
+  std::atomic<bool> isEnded;
+  uint32_t channelCount;
+  // Samples from writes that haven’t fit in the ring yet, and the function to
+  // call when they have.
+  std::vector<MYFLT> pendingSamples;
+  size_t pendingSampleIndex;
+  Nan::Callback writeCallback;
+  // Bytes at the end of a Buffer that don’t form a whole sample.
+  char partialSample[sizeof(double)];
+  size_t partialSampleLength;
+
+  static NAN_METHOD(New) {
+    (new CsoundInputStreamWrapper())->Wrap(info.This());
+    info.GetReturnValue().Set(info.This());
+  }
+
+  static void asyncCallback(uv_async_t *handle) {
+    if (handle->data)
+      ((CsoundInputStreamWrapper *)handle->data)->pushPendingSamples();
+  }
+
+  CsoundInputStreamWrapper() : underrunFrameCounter(0), isEnded(false), channelCount(1), pendingSampleIndex(0), partialSampleLength(0) {
+    handle = new uv_async_t;
+    assert(uv_async_init(uv_default_loop(), handle, asyncCallback) == 0);
+    handle->data = this;
+  }
+  ~CsoundInputStreamWrapper() {
+    handle->data = NULL;
+    uv_close((uv_handle_t *)handle, [](uv_handle_t *handle) { delete (uv_async_t *)handle; });
+  }
+
+  // Called on the performance thread before each control period.
+  void CsoundWillPerformKsmps(CSOUND *Csound) {
+    uint32_t frameCount = csoundGetKsmps(Csound);
+    size_t sampleCount = (size_t)frameCount * channelCount;
+    if (!isRealtime)
+      waitUntil([&] { return ring->read_available() >= sampleCount || isEnded.load(); });
+    MYFLT *spin = csoundGetSpin(Csound);
+    size_t poppedSampleCount = ring->pop(spin, sampleCount);
+    if (poppedSampleCount < sampleCount) {
+      memset(spin + poppedSampleCount, 0, sizeof(MYFLT) * (sampleCount - poppedSampleCount));
+      if (!isEnded.load())
+        underrunFrameCounter.fetch_add(frameCount - poppedSampleCount / channelCount, std::memory_order_relaxed);
+    }
+    if (poppedSampleCount > 0)
+      uv_async_send(handle);
+  }
+
+  // Called on the main thread.
+  void pushPendingSamples() {
+    if (pendingSampleIndex < pendingSamples.size()) {
+      pendingSampleIndex += ring->push(pendingSamples.data() + pendingSampleIndex, pendingSamples.size() - pendingSampleIndex);
+      notifyPerformanceThread();
+    }
+    if (pendingSampleIndex == pendingSamples.size() && !writeCallback.IsEmpty()) {
+      Nan::HandleScope scope;
+      Nan::AsyncResource resource("csound-api:callback");
+      Nan::Callback callback(writeCallback.GetFunction());
+      writeCallback.Reset();
+      callback.Call(0, NULL, &resource);
+    }
+  }
+
+  static NAN_METHOD(write) {
+    CsoundInputStreamWrapper *wrapper = Unwrap<CsoundInputStreamWrapper>(info.This());
+    if (!node::Buffer::HasInstance(info[0])) {
+      Nan::ThrowTypeError("Argument 1 of write must be a Buffer.");
+      return;
+    }
+    if (!wrapper->writeCallback.IsEmpty()) {
+      Nan::ThrowError("Cannot write to an input stream before the previous write finishes.");
+      return;
+    }
+    if (wrapper->isEnded.load()) {
+      Nan::ThrowError("Cannot write to an input stream after it ends.");
+      return;
+    }
+
+    const char *bytes = node::Buffer::Data(info[0]);
+    size_t byteCount = node::Buffer::Length(info[0]);
+    size_t bytesPerSample = bytesPerSampleOfFormat(wrapper->format);
+    // Keep samples from earlier writes (without callbacks) that are still
+    // pending, and add this write’s samples after them.
+    wrapper->pendingSamples.erase(wrapper->pendingSamples.begin(), wrapper->pendingSamples.begin() + wrapper->pendingSampleIndex);
+    wrapper->pendingSampleIndex = 0;
+    if (wrapper->partialSampleLength > 0) {
+      size_t length = std::min(bytesPerSample - wrapper->partialSampleLength, byteCount);
+      memcpy(wrapper->partialSample + wrapper->partialSampleLength, bytes, length);
+      wrapper->partialSampleLength += length;
+      bytes += length;
+      byteCount -= length;
+      if (wrapper->partialSampleLength == bytesPerSample) {
+        wrapper->pendingSamples.push_back(wrapper->sampleFromBytes(wrapper->partialSample));
+        wrapper->partialSampleLength = 0;
+      }
+    }
+    for (; byteCount >= bytesPerSample; bytes += bytesPerSample, byteCount -= bytesPerSample) {
+      wrapper->pendingSamples.push_back(wrapper->sampleFromBytes(bytes));
+    }
+    memcpy(wrapper->partialSample + wrapper->partialSampleLength, bytes, byteCount);
+    wrapper->partialSampleLength += byteCount;
+
+    if (info[1]->IsFunction())
+      wrapper->writeCallback.Reset(info[1].As<v8::Function>());
+    wrapper->pushPendingSamples();
+  }
+
+  static NAN_METHOD(end) {
+    CsoundInputStreamWrapper *wrapper = Unwrap<CsoundInputStreamWrapper>(info.This());
+    wrapper->isEnded.store(true);
+    wrapper->notifyPerformanceThread();
+  }
+
+  static NAN_GETTER(underrunFrameCount) {
+    info.GetReturnValue().Set(Nan::New((double)Unwrap<CsoundInputStreamWrapper>(info.This())->underrunFrameCounter.load()));
+  }
+};
+
+// A CsoundParseTreeCache keeps the parse trees of orchestras compiled using
+// CompileOrc, so that compiling the same orchestra again skips the parser.
+// Trees are allocated by (and can only be compiled by) the instance of Csound
+// that parsed them, so each instance has its own cache, which is cleared when
+// the instance is reset or destroyed. Entries are keyed by a hash of the
+// orchestra, and the least recently used entries are evicted when the cache
+// exceeds its limits.
+struct CsoundParseTreeCache {
+  struct Entry {
+    size_t hash;
+    std::string orchestra;
+    TREE *tree;
+  };
+
+  size_t maxEntryCount;
+  size_t maxByteCount;
+  size_t byteCount;
+  uint32_t hitCount;
+  uint32_t missCount;
+  uint32_t evictionCount;
+  // Entries in order from most to least recently used.
+  std::list<Entry> entries;
+  std::unordered_multimap<size_t, std::list<Entry>::iterator> entriesByHash;
+
+  CsoundParseTreeCache(size_t maxEntryCount, size_t maxByteCount) : maxEntryCount(maxEntryCount), maxByteCount(maxByteCount), byteCount(0), hitCount(0), missCount(0), evictionCount(0) {}
+
+  // Returns a tree for the orchestra, parsing and caching the orchestra if
+  // needed, and sets isCached to whether the cache owns the tree. This returns
+  // NULL if the orchestra can’t be parsed.
+  TREE *treeForOrchestra(CSOUND *Csound, const char *orchestra, bool &isCached) {
+    isCached = true;
+    size_t length = strlen(orchestra);
+    size_t hash = std::hash<std::string>()(std::string(orchestra, length));
+    auto range = entriesByHash.equal_range(hash);
+    for (auto iterator = range.first; iterator != range.second; ++iterator) {
+      if (iterator->second->orchestra == orchestra) {
+        hitCount++;
+        entries.splice(entries.begin(), entries, iterator->second);
+        return iterator->second->tree;
+      }
+    }
+
+    missCount++;
+    TREE *tree = csoundParseOrc(Csound, orchestra);
+    if (!tree || length > maxByteCount || maxEntryCount == 0) {
+      isCached = false;
+      return tree;
+    }
+    entries.push_front({hash, std::string(orchestra, length), tree});
+    entriesByHash.emplace(hash, entries.begin());
+    byteCount += length;
+    while (entries.size() > maxEntryCount || byteCount > maxByteCount) {
+      removeLeastRecentlyUsedEntry(Csound);
+      evictionCount++;
+    }
+    return tree;
+  }
+
+  void removeLeastRecentlyUsedEntry(CSOUND *Csound) {
+    Entry &entry = entries.back();
+    auto range = entriesByHash.equal_range(entry.hash);
+    for (auto iterator = range.first; iterator != range.second; ++iterator) {
+      if (&*iterator->second == &entry) {
+        entriesByHash.erase(iterator);
+        break;
+      }
+    }
+    byteCount -= entry.orchestra.size();
+    csoundDeleteTree(Csound, entry.tree);
+    entries.pop_back();
+  }
+
+  void clear(CSOUND *Csound) {
+    while (!entries.empty()) {
+      removeLeastRecentlyUsedEntry(Csound);
+    }
+  }
+};
+
+// A CsoundTimeHistogram records durations in nanoseconds in log-linear buckets:
+// each power of 2 is split into 16 buckets, so recorded values are accurate to
+// about 6%. Durations are recorded on a performance thread and read on the main
+// thread, so counts are relaxed atomics and recording never blocks.
+struct CsoundTimeHistogram {
+  static const int subBucketBitCount = 4;
+  static const uint64_t subBucketCount = 1 << subBucketBitCount;
+  // Durations up to 2^40 nanoseconds (about 18 minutes) are distinguished.
+  static const int maxExponent = 40;
+  static const size_t bucketCount = (maxExponent - subBucketBitCount + 1) * subBucketCount;
+
+  std::atomic<uint64_t> counts[bucketCount];
+  std::atomic<uint64_t> count;
+  std::atomic<uint64_t> sum;
+  std::atomic<uint64_t> max;
+
+  CsoundTimeHistogram() {
+    reset();
+  }
+
+  void reset() {
+    for (size_t i = 0; i < bucketCount; i++) {
+      counts[i].store(0, std::memory_order_relaxed);
+    }
+    count.store(0, std::memory_order_relaxed);
+    sum.store(0, std::memory_order_relaxed);
+    max.store(0, std::memory_order_relaxed);
+  }
+
+  static size_t bucketIndexOfValue(uint64_t value) {
+    if (value < subBucketCount)
+      return value;
+    int exponent = 0;
+    for (uint64_t shiftedValue = value; shiftedValue >>= 1;) {
+      exponent++;
+    }
+    if (exponent >= maxExponent)
+      return bucketCount - 1;
+    return (exponent - subBucketBitCount + 1) * subBucketCount + ((value >> (exponent - subBucketBitCount)) - subBucketCount);
+  }
+
+  // Returns the midpoint of the range of values in a bucket.
+  static double valueOfBucketIndex(size_t index) {
+    if (index < subBucketCount)
+      return index;
+    int exponent = (int)(index / subBucketCount) + subBucketBitCount - 1;
+    double bucketWidth = std::ldexp(1, exponent - subBucketBitCount);
+    return (subBucketCount + index % subBucketCount) * bucketWidth + bucketWidth / 2;
+  }
+
+  // Only one thread records durations at a time, so the maximum can be updated
+  // without a compare-and-swap loop.
+  void record(uint64_t nanoseconds) {
+    counts[bucketIndexOfValue(nanoseconds)].fetch_add(1, std::memory_order_relaxed);
+    count.fetch_add(1, std::memory_order_relaxed);
+    sum.fetch_add(nanoseconds, std::memory_order_relaxed);
+    if (nanoseconds > max.load(std::memory_order_relaxed))
+      max.store(nanoseconds, std::memory_order_relaxed);
+  }
+
+  uint64_t totalNanoseconds() const {
+    return sum.load(std::memory_order_relaxed);
+  }
+
+  // Returns an object with the count of recorded durations and their mean,
+  // percentiles, and maximum in milliseconds.
+  v8::Local<v8::Object> newStats() const {
+    static const double percentiles[] = {50, 90, 99, 99.9};
+    static const char *percentileKeys[] = {"p50", "p90", "p99", "p999"};
+    const size_t percentileCount = sizeof(percentiles) / sizeof(percentiles[0]);
+
+    uint64_t snapshotCounts[bucketCount];
+    uint64_t snapshotCount = 0;
+    for (size_t i = 0; i < bucketCount; i++) {
+      snapshotCounts[i] = counts[i].load(std::memory_order_relaxed);
+      snapshotCount += snapshotCounts[i];
+    }
+
+    double percentileValues[percentileCount] = {0};
+    uint64_t cumulativeCount = 0;
+    size_t percentileIndex = 0;
+    for (size_t i = 0; i < bucketCount && percentileIndex < percentileCount && snapshotCount > 0; i++) {
+      cumulativeCount += snapshotCounts[i];
+      while (percentileIndex < percentileCount && cumulativeCount >= std::ceil(percentiles[percentileIndex] / 100 * snapshotCount)) {
+        percentileValues[percentileIndex] = valueOfBucketIndex(i) / 1e6;
+        percentileIndex++;
+      }
+    }
+
+    v8::Local<v8::Object> stats = Nan::New<v8::Object>();
+    Nan::Set(stats, Nan::New("count").ToLocalChecked(), Nan::New((double)snapshotCount));
+    Nan::Set(stats, Nan::New("meanMilliseconds").ToLocalChecked(), Nan::New(snapshotCount > 0 ? sum.load(std::memory_order_relaxed) / 1e6 / snapshotCount : 0));
+    for (size_t i = 0; i < percentileCount; i++) {
+      Nan::Set(stats, Nan::New(percentileKeys[i]).ToLocalChecked(), Nan::New(percentileValues[i]));
+    }
+    Nan::Set(stats, Nan::New("maxMilliseconds").ToLocalChecked(), Nan::New(max.load(std::memory_order_relaxed) / 1e6));
+    return stats;
+  }
+};
+
+// CsoundPerformanceStats measures the control periods of asynchronous
+// performances. The real-time budget of a control period is ksmps/sr seconds;
+// a control period that takes longer than that (including the time spent
+// running queued calls) would cause a dropout when performing in real time.
+struct CsoundPerformanceStats {
+  CsoundTimeHistogram performKsmpsTimes;
+  CsoundTimeHistogram eventDrainTimes;
+  std::atomic<uint64_t> overrunCount;
+  double budgetNanoseconds;
+  std::chrono::steady_clock::time_point controlPeriodStartTime;
+  uint64_t controlPeriodPerformNanoseconds;
+
+  CsoundPerformanceStats() : overrunCount(0), budgetNanoseconds(0), controlPeriodPerformNanoseconds(0) {}
+
+  void reset(CSOUND *Csound) {
+    performKsmpsTimes.reset();
+    eventDrainTimes.reset();
+    overrunCount.store(0, std::memory_order_relaxed);
+    MYFLT sampleRate = csoundGetSr(Csound);
+    budgetNanoseconds = sampleRate > 0 ? 1e9 * csoundGetKsmps(Csound) / sampleRate : 0;
+  }
+
+  static uint64_t nanosecondsSince(std::chrono::steady_clock::time_point time) {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - time).count();
+  }
+
+  // These functions are called on the performance thread.
+  void CsoundWillPerformKsmps() {
+    controlPeriodStartTime = std::chrono::steady_clock::now();
+  }
+  void CsoundDidPerformKsmps() {
+    controlPeriodPerformNanoseconds = nanosecondsSince(controlPeriodStartTime);
+    performKsmpsTimes.record(controlPeriodPerformNanoseconds);
+  }
+  void CsoundWillDrainEvents() {
+    controlPeriodStartTime = std::chrono::steady_clock::now();
+  }
+  void CsoundDidDrainEvents() {
+    uint64_t nanoseconds = nanosecondsSince(controlPeriodStartTime);
+    eventDrainTimes.record(nanoseconds);
+    if (budgetNanoseconds > 0 && controlPeriodPerformNanoseconds + nanoseconds > budgetNanoseconds)
+      overrunCount.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  v8::Local<v8::Object> newStats() const {
+    v8::Local<v8::Object> stats = Nan::New<v8::Object>();
+    uint64_t controlPeriodCount = performKsmpsTimes.count.load(std::memory_order_relaxed);
+    Nan::Set(stats, Nan::New("controlPeriods").ToLocalChecked(), Nan::New((double)controlPeriodCount));
+    Nan::Set(stats, Nan::New("budgetMilliseconds").ToLocalChecked(), Nan::New(budgetNanoseconds / 1e6));
+    Nan::Set(stats, Nan::New("overruns").ToLocalChecked(), Nan::New((double)overrunCount.load(std::memory_order_relaxed)));
+    double totalNanoseconds = performKsmpsTimes.totalNanoseconds() + eventDrainTimes.totalNanoseconds();
+    Nan::Set(stats, Nan::New("dspLoad").ToLocalChecked(), Nan::New(controlPeriodCount > 0 && budgetNanoseconds > 0 ? 100 * totalNanoseconds / (controlPeriodCount * budgetNanoseconds) : 0));
+    Nan::Set(stats, Nan::New("performKsmps").ToLocalChecked(), performKsmpsTimes.newStats());
+    Nan::Set(stats, Nan::New("eventDrain").ToLocalChecked(), eventDrainTimes.newStats());
+    return stats;
+  }
+};
+
+// CSOUNDWrapper instances perform tasks related to callbacks. They also store
+// V8 values passed as host data from JavaScript.
+static Nan::Persistent<v8::Function> CSOUNDProxyConstructor;
+struct CsoundOpcodeIndex;
+// Incremented when instances of Csound created or reset afterward may load a
+// different set of plugins.
+static std::atomic<uint64_t> CsoundOpcodeIndexGeneration(0);
+
+// Whether compiling orchestra code may define opcodes. User-defined opcodes
+// start with the opcode keyword, but they can also come from included files.
+static bool orchestraMayDefineOpcodes(const char *orchestra) {
+  return strstr(orchestra, "opcode") || strstr(orchestra, "#include");
+}
+
+struct CSOUNDWrapper : public Nan::ObjectWrap {
+  CSOUND *Csound;
+  Nan::Persistent<v8::Value, Nan::CopyablePersistentTraits<v8::Value>> hostData;
+  CsoundEventHandler *eventHandler;
+  // ScoreEvent converts parameter field values into this buffer, which is
+  // reused so that sending a score event doesn’t allocate memory.
+  std::vector<MYFLT> parameterFieldValueBuffer;
+
+  // Typed arrays that view memory owned by Csound (like the spin and spout
+  // buffers), keyed by the address of the memory. Csound frees this memory when
+  // an instance is reset or destroyed, so invalidateCsoundMemory detaches these
+  // arrays before that happens.
+  std::map<MYFLT *, Nan::Persistent<MYFLTArray, Nan::CopyablePersistentTraits<MYFLTArray>>> CsoundMemoryViews;
+  std::set<CsoundChannelPointerOwner *> channelPointerOwners;
+
+  bool isPerformingAsynchronously;
+  bool isCompilingAsynchronously;
+  CsoundPerformanceStats performanceStats;
+  CsoundBindingCounters bindingCounters;
+
+  // The value of CsoundOpcodeIndexGeneration when this instance was created or
+  // last reset, and whether it may have compiled user-defined opcodes or
+  // loaded plugins since. Only instances with the current generation that
+  // haven’t defined opcodes use the index shared by other instances; others
+  // index their opcode list separately, and opcodeIndex is empty until the
+  // index is needed after the instance compiles opcodes.
+  uint64_t opcodeIndexGeneration;
+  bool mayDefineOpcodes;
+  std::shared_ptr<CsoundOpcodeIndex> opcodeIndex;
+  // Audio streams attached to this instance, along with their JavaScript
+  // objects to keep them alive while attached.
+  CsoundOutputStreamWrapper *outputStream;
+  Nan::Persistent<v8::Object> outputStreamObject;
+  CsoundInputStreamWrapper *inputStream;
+  Nan::Persistent<v8::Object> inputStreamObject;
+
+  // This is NULL unless SetParseTreeCache is called.
+  CsoundParseTreeCache *parseTreeCache;
+
+  CsoundCallback<CsoundFileOpenCallbackArguments> *CsoundFileOpenCallbackObject;
+
+  CsoundCallback<CsoundMessageCallbackArguments> *CsoundMessageCallbackObject;
+  CsoundMessageBatch *CsoundMessageBatchObject;
+  CsoundAtomicMessageFilter messageFilter;
+
+  CsoundCallback<CsoundMakeGraphCallbackArguments> *CsoundMakeGraphCallbackObject;
+  CsoundCallback<CsoundGraphCallbackArguments> *CsoundDrawGraphCallbackObject;
+  CsoundCoalescingGraphCallback *CsoundDrawGraphCoalescingObject;
+  CsoundCallback<CsoundGraphCallbackArguments> *CsoundKillGraphCallbackObject;
+
+  // Require Csound 6.04 or later to use debugger functions.
+#define CSOUND_6_04_OR_LATER CS_VERSION >= 6 && CS_SUBVER >= 4
+#if CSOUND_6_04_OR_LATER
+  Nan::Callback *CsoundBreakpointCallbackObject;
+#endif
+
+  static NAN_METHOD(New) {
+    (new CSOUNDWrapper())->Wrap(info.This());
+    info.GetReturnValue().Set(info.This());
+  }
+
+  CSOUNDWrapper() : isPerformingAsynchronously(false), isCompilingAsynchronously(false), opcodeIndexGeneration(0), mayDefineOpcodes(false), outputStream(NULL), inputStream(NULL), parseTreeCache(NULL), CsoundMessageCallbackObject(NULL), CsoundMessageBatchObject(NULL), CsoundDrawGraphCallbackObject(NULL), CsoundDrawGraphCoalescingObject(NULL) {
+    eventHandler = new CsoundSynchronousEventHandler();
+  }
+  ~CSOUNDWrapper() {
+    delete eventHandler;
+    delete parseTreeCache;
+  }
+
+  v8::Local<v8::Value> viewOfCsoundMemory(MYFLT *data, size_t length) {
+    if (!data)
+      return Nan::Null();
+
+    Nan::Persistent<MYFLTArray, Nan::CopyablePersistentTraits<MYFLTArray>> &persistentView = CsoundMemoryViews[data];
+    if (!persistentView.IsEmpty()) {
+      v8::Local<MYFLTArray> view = Nan::New(persistentView);
+      if (view->Length() == length)
+        return view;
+      detachArrayBuffer(view->Buffer());
+    }
+
+    v8::Local<MYFLTArray> view = MYFLTArray::New(newArrayBufferWithExternalData(data, sizeof(MYFLT) * length), 0, length);
+    persistentView.Reset(view);
+    return view;
+  }
+
+  void invalidateCsoundMemory() {
+    Nan::HandleScope scope;
+    for (auto &entry : CsoundMemoryViews) {
+      detachArrayBuffer(Nan::New(entry.second)->Buffer());
+      entry.second.Reset();
+    }
+    CsoundMemoryViews.clear();
+
+    for (CsoundChannelPointerOwner *owner : channelPointerOwners) {
+      owner->invalidateChannelPointers();
+    }
+    channelPointerOwners.clear();
+
+    detachAudioStreams();
+
+    if (parseTreeCache)
+      parseTreeCache->clear(Csound);
+    mayDefineOpcodes = false;
+    opcodeIndex.reset();
+  }
+
+  void noteOpcodesMayBeDefined() {
+    mayDefineOpcodes = true;
+    opcodeIndex.reset();
+  }
+
+  int compileOrchestra(const char *orchestra) {
+    if (orchestraMayDefineOpcodes(orchestra))
+      noteOpcodesMayBeDefined();
+    // While Csound performs in the background, orchestras are compiled on the
+    // performance thread without using the parse tree cache.
+    if (!parseTreeCache || isPerformingAsynchronously)
+      return eventHandler->handleCompileOrc(Csound, const_cast<char *>(orchestra));
+
+    bool isCached;
+    TREE *tree = parseTreeCache->treeForOrchestra(Csound, orchestra, isCached);
+    if (!tree)
+      return CSOUND_ERROR;
+    int status = csoundCompileTree(Csound, tree);
+    if (!isCached)
+      csoundDeleteTree(Csound, tree);
+    return status;
+  }
+
+  void detachAudioStreams() {
+    detachOutputStream();
+    detachInputStream();
+  }
+  void detachOutputStream() {
+    if (outputStream) {
+      outputStream->CsoundDidStop();
+      outputStream = NULL;
+      outputStreamObject.Reset();
+    }
+  }
+  void detachInputStream() {
+    if (inputStream) {
+      inputStream->CsoundDidStop();
+      inputStream = NULL;
+      inputStreamObject.Reset();
+    }
+  }
+
+  // Called on a performance thread to perform a control period and exchange
+  // samples with attached audio streams.
+  int performKsmps() {
+    if (inputStream)
+      inputStream->CsoundWillPerformKsmps(Csound);
+    performanceStats.CsoundWillPerformKsmps();
+    int result = csoundPerformKsmps(Csound);
+    performanceStats.CsoundDidPerformKsmps();
+    if (!result && outputStream)
+      outputStream->CsoundDidPerformKsmps(Csound);
+    return result;
+  }
+
+  // Called on a performance thread after each control period to run queued
+  // calls. Returns true if the performance should stop.
+  bool runQueuedCalls() {
+    performanceStats.CsoundWillDrainEvents();
+    bool shouldStop = eventHandler->CsoundDidPerformKsmps(Csound);
+    performanceStats.CsoundDidDrainEvents();
+    return shouldStop;
+  }
+
+  // Called on the main thread when an asynchronous performance starts or
+  // finishes. While performing asynchronously, calls that affect the
+  // performance are queued to run on the performance thread.
+  void CsoundWillPerformAsynchronously() {
+    delete eventHandler;
+    eventHandler = new CsoundAsynchronousEventHandler(&bindingCounters);
+    performingCsoundInstanceCount = performingCsoundInstanceCount + 1;
+    isPerformingAsynchronously = true;
+    performanceStats.reset(Csound);
+    if (outputStream)
+      outputStream->CsoundWillPerform();
+    if (inputStream)
+      inputStream->CsoundWillPerform();
+  }
+  void CsoundDidPerformAsynchronously() {
+    eventHandler->CsoundDidPerformKsmps(Csound);
+    delete eventHandler;
+    eventHandler = new CsoundSynchronousEventHandler();
+    isPerformingAsynchronously = false;
+    if (outputStream)
+      outputStream->CsoundDidFinishPerformance();
+  }
+};
+
+// The CSOUND_CALLBACK_METHOD macro associates a Csound callback function with a
+// CsoundCallback instance using an appropriate argument type. For example,
+// CSOUND_CALLBACK_METHOD(Message) associates csoundSetMessageCallback with
+// CsoundCallback<CsoundMessageCallbackArguments>;
+// CSOUND_CALLBACK_METHOD(MakeGraph) associates csoundSetMakeGraphCallback with
+// CsoundCallback<CsoundMakeGraphCallbackArguments>; and so on.
+#define CSOUND_CALLBACK_METHOD_1(methodNameStem) CSOUND_CALLBACK_METHOD_2(methodNameStem, methodNameStem)
+#define CSOUND_CALLBACK_METHOD_2(methodNameStem, argumentsNameStem) \
+NAN_METHOD(Set ## methodNameStem ## Callback) { \
+  CSOUNDWrapper *wrapper = Nan::ObjectWrap::Unwrap<CSOUNDWrapper>(info[0].As<v8::Object>()); \
+  v8::Local<v8::Value> value = info[1]; \
+  if (value->IsFunction()) { \
+    wrapper->Csound ## methodNameStem ## CallbackObject = new CsoundCallback<Csound ## argumentsNameStem ## CallbackArguments>(value.As<v8::Function>(), &wrapper->bindingCounters, CsoundBindingCounter ## methodNameStem ## QueueDepth); \
+    csoundSet ## methodNameStem ## Callback(wrapper->Csound, Csound ## methodNameStem ## Callback); \
+  } else if (wrapper->Csound ## methodNameStem ## CallbackObject) { \
+    delete wrapper->Csound ## methodNameStem ## CallbackObject; \
+    wrapper->Csound ## methodNameStem ## CallbackObject = NULL; \
+    csoundSet ## methodNameStem ## Callback(wrapper->Csound, NULL); \
+  } \
+}
+#ifndef _MSC_VER
+#  define CSOUND_CALLBACK_METHOD(...) BOOST_PP_OVERLOAD(CSOUND_CALLBACK_METHOD_,__VA_ARGS__)(__VA_ARGS__)
+#else
+#  define CSOUND_CALLBACK_METHOD(...) BOOST_PP_CAT(BOOST_PP_OVERLOAD(CSOUND_CALLBACK_METHOD_,__VA_ARGS__)(__VA_ARGS__),BOOST_PP_EMPTY())
+#endif
+
+// Helper function to set return values to either a string or null.
+static void setReturnValueWithCString(Nan::ReturnValue<v8::Value> returnValue, const char *string) {
+  if (string)
+    returnValue.Set(Nan::New(string).ToLocalChecked());
+  else
+    returnValue.SetNull();
+}
+
+// These signal handlers save signals raised while Csound instances are
+// performing in the background (see performingCsoundInstanceCount above).
+#define SIGNAL_HANDLER_FUNCTION(SIGNAL) \
+  static void handle ## SIGNAL(int sig) { \
+    if (performingCsoundInstanceCount == 0) { \
+      signal(sig, SIG_DFL); \
+      raise(sig); \
+    } else { \
+      raisedSignal = sig; \
+    } \
+  }
+SIGNAL_HANDLER_FUNCTION(SIGINT)
+SIGNAL_HANDLER_FUNCTION(SIGTERM)
+
+static int initializeCsound(int flags) {
+  int result = csoundInitialize(flags | CSOUNDINIT_NO_SIGNAL_HANDLER);
+
+  // csoundInitialize returns 0 when initialization is successful, which should
+  // happen only once.
+  if (result == 0 && !(flags & CSOUNDINIT_NO_SIGNAL_HANDLER)) {
+    signal(SIGINT, handleSIGINT);
+    signal(SIGTERM, handleSIGTERM);
+  }
+
+  return result;
+}
+
+static NAN_METHOD(Initialize) {
+  info.GetReturnValue().Set(initializeCsound(Nan::To<int32_t>(info[0]).FromJust()));
+}
+
+struct CsoundInitializationOption {
+  static NAN_GETTER(NoSignalHandlers) { info.GetReturnValue().Set(CSOUNDINIT_NO_SIGNAL_HANDLER); }
+  static NAN_GETTER(NoExitFunction)   { info.GetReturnValue().Set(CSOUNDINIT_NO_ATEXIT); }
+};
+
+// The token type of instrument definitions depends only on the version of
+// Csound, so QueryTree uses a type found once per process by parsing an
+// instrument. Creating an instance of Csound just for this would load plugins
+// and initialize Csound (preventing a later call to Initialize), so the type is
+// found using the first instance created by Create or an instance pool, before
+// it’s passed to JavaScript.
+static int CsoundInstrumentNodeType = -1;
+static std::once_flag CsoundInstrumentNodeTypeFlag;
+
+static void findInstrumentNodeType(CSOUND *Csound) {
+  std::call_once(CsoundInstrumentNodeTypeFlag, [Csound] {
+    csoundSetMessageCallback(Csound, [](CSOUND *Csound, int attributes, const char *format, va_list argumentList) {});
+    TREE *instrumentTree = csoundParseOrc(Csound, "instr 1\nendin\n");
+    if (instrumentTree) {
+      CsoundInstrumentNodeType = instrumentTree->type;
+      csoundDeleteTree(Csound, instrumentTree);
+    }
+    csoundSetMessageCallback(Csound, NULL);
+  });
+}
+
+static NAN_METHOD(Create) {
+  initializeCsound(0);
+
+  v8::Local<v8::Object> proxy = Nan::NewInstance(Nan::New(CSOUNDProxyConstructor)).ToLocalChecked();
+  CSOUNDWrapper *wrapper = Nan::ObjectWrap::Unwrap<CSOUNDWrapper>(proxy);
+  wrapper->opcodeIndexGeneration = CsoundOpcodeIndexGeneration.load();
+  CSOUND *Csound = csoundCreate(wrapper);
+  if (Csound) {
+    findInstrumentNodeType(Csound);
+    wrapper->Csound = Csound;
+    wrapper->hostData.Reset(info[0]);
+    info.GetReturnValue().Set(proxy);
+  } else {
+    info.GetReturnValue().SetNull();
+  }
+}
+
+static CSOUND *CsoundFromFunctionCallbackInfo(Nan::NAN_METHOD_ARGS_TYPE info) {
+  return Nan::ObjectWrap::Unwrap<CSOUNDWrapper>(info[0].As<v8::Object>())->Csound;
+}
+
+// While an instance of Csound compiles on a worker thread, functions that use
+// the instance throw an exception.
+static bool throwIfCompilingAsynchronously(CSOUNDWrapper *wrapper, const char *functionName) {
+  if (wrapper->isCompilingAsynchronously) {
+    Nan::ThrowError((std::string("Cannot call ") + functionName + " while Csound is compiling.").c_str());
+    return true;
+  }
+  return false;
+}
+
+// Functions that compile CSDs or command-line arguments, or start Csound, can’t
+// be queued to run on the performance thread, so they throw an exception while
+// Csound performs in the background.
+static bool throwIfPerformingAsynchronously(CSOUNDWrapper *wrapper, const char *functionName) {
+  if (wrapper->isPerformingAsynchronously) {
+    Nan::ThrowError((std::string("Cannot call ") + functionName + " while Csound is performing.").c_str());
+    return true;
+  }
+  return false;
+}
+
+static CSOUND *availableCsoundFromFunctionCallbackInfo(Nan::NAN_METHOD_ARGS_TYPE info, const char *functionName) {
+  CSOUNDWrapper *wrapper = Nan::ObjectWrap::Unwrap<CSOUNDWrapper>(info[0].As<v8::Object>());
+  return throwIfCompilingAsynchronously(wrapper, functionName) ? NULL : wrapper->Csound;
+}
+
+static CSOUND *idleCsoundFromFunctionCallbackInfo(Nan::NAN_METHOD_ARGS_TYPE info, const char *functionName) {
+  CSOUNDWrapper *wrapper = Nan::ObjectWrap::Unwrap<CSOUNDWrapper>(info[0].As<v8::Object>());
+  return throwIfPerformingAsynchronously(wrapper, functionName) ? NULL : availableCsoundFromFunctionCallbackInfo(info, functionName);
+}
+
+// Functions that use an instance of Csound (passed as the first argument) are
+// exported using setCsoundMethod, which wraps them in callIfCsoundIsAvailable
+// so that they throw an exception instead of running while the instance
+// compiles on a worker thread. The name of the function is the data of its
+// function template.
+template <Nan::FunctionCallback function>
+static NAN_METHOD(callIfCsoundIsAvailable) {
+  if (info[0]->IsObject() && Nan::ObjectWrap::Unwrap<CSOUNDWrapper>(info[0].As<v8::Object>())->isCompilingAsynchronously) {
+    Nan::ThrowError((std::string("Cannot call ") + *Nan::Utf8String(info.Data()) + " while Csound is compiling.").c_str());
+    return;
+  }
+  function(info);
+}
+
+template <Nan::FunctionCallback function>
+static void setCsoundMethod(v8::Local<v8::Object> target, const char *name) {
+  v8::Local<v8::String> functionName = Nan::New(name).ToLocalChecked();
+  v8::Local<v8::Function> method = Nan::GetFunction(Nan::New<v8::FunctionTemplate>(callIfCsoundIsAvailable<function>, functionName)).ToLocalChecked();
+  method->SetName(functionName);
+  Nan::Set(target, functionName, method);
+}
+
+static NAN_METHOD(Destroy) {
+  CSOUNDWrapper *wrapper = Nan::ObjectWrap::Unwrap<CSOUNDWrapper>(info[0].As<v8::Object>());
+  if (throwIfCompilingAsynchronously(wrapper, "Destroy"))
+    return;
+  wrapper->invalidateCsoundMemory();
+  csoundDestroy(wrapper->Csound);
+}
+
+// An instance pool creates instances of Csound on a background thread, so that
+// creating an instance (which includes loading opcode plugins) doesn’t delay a
+// request for one. Released instances are reset on the same thread and reused.
+static Nan::Persistent<v8::Function> InstancePoolProxyConstructor;
+struct CsoundInstancePoolWrapper : public Nan::ObjectWrap {
+  size_t size;
+  std::vector<std::string> options;
+  std::thread thread;
+  std::mutex mutex;
+  std::condition_variable workAvailable;
+  // Idle instances along with their values of CsoundOpcodeIndexGeneration.
+  std::vector<std::pair<CSOUND *, uint64_t>> idleInstances;
+  std::deque<CSOUND *> instancesToReset;
+  size_t instancesToCreateCount;
+  bool isClosed;
+
+  uint32_t acquisitionCount;
+  uint32_t coldAcquisitionCount;
+  double totalAcquisitionMilliseconds;
+  double maxAcquisitionMilliseconds;
+
+  static NAN_METHOD(New) {
+    (new CsoundInstancePoolWrapper())->Wrap(info.This());
+    info.GetReturnValue().Set(info.This());
+  }
+
+  CsoundInstancePoolWrapper() : size(0), instancesToCreateCount(0), isClosed(false), acquisitionCount(0), coldAcquisitionCount(0), totalAcquisitionMilliseconds(0), maxAcquisitionMilliseconds(0) {}
+  ~CsoundInstancePoolWrapper() {
+    closePool();
+  }
+
+  void start() {
+    instancesToCreateCount = size;
+    thread = std::thread(&CsoundInstancePoolWrapper::run, this);
+  }
+
+  void closePool() {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      if (isClosed)
+        return;
+      isClosed = true;
+      workAvailable.notify_one();
+    }
+    thread.join();
+    for (auto &idleInstance : idleInstances) {
+      csoundDestroy(idleInstance.first);
+    }
+    idleInstances.clear();
+    for (CSOUND *Csound : instancesToReset) {
+      csoundDestroy(Csound);
+    }
+    instancesToReset.clear();
+  }
+
+  CSOUND *newInstance() {
+    CSOUND *Csound = csoundCreate(NULL);
+    if (Csound)
+      setOptions(Csound);
+    return Csound;
+  }
+
+  void setOptions(CSOUND *Csound) {
+    for (const std::string &option : options) {
+      csoundSetOption(Csound, option.c_str());
+    }
+  }
+
+  // Called on the pool thread.
+  void run() {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+      workAvailable.wait(lock, [this] { return isClosed || instancesToCreateCount > 0 || !instancesToReset.empty(); });
+      if (isClosed)
+        break;
+
+      CSOUND *Csound;
+      uint64_t opcodeIndexGeneration = CsoundOpcodeIndexGeneration.load();
+      if (!instancesToReset.empty()) {
+        Csound = instancesToReset.front();
+        instancesToReset.pop_front();
+        lock.unlock();
+        csoundReset(Csound);
+        setOptions(Csound);
+      } else {
+        instancesToCreateCount--;
+        lock.unlock();
+        Csound = newInstance();
+      }
+      lock.lock();
+
+      if (!Csound)
+        continue;
+      if (idleInstances.size() < size)
+        idleInstances.emplace_back(Csound, opcodeIndexGeneration);
+      else
+        csoundDestroy(Csound);
+    }
+  }
+
+  // Called on the main thread with the mutex locked. Keeps the number of idle
+  // instances, plus instances being created or reset, at the size of the pool.
+  void replenish() {
+    if (idleInstances.size() + instancesToCreateCount + instancesToReset.size() < size) {
+      instancesToCreateCount++;
+      workAvailable.notify_one();
+    }
+  }
+
+  static NAN_METHOD(acquire) {
+    std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+    CsoundInstancePoolWrapper *pool = Unwrap<CsoundInstancePoolWrapper>(info.This());
+    if (pool->isClosed) {
+      Nan::ThrowError("Cannot acquire an instance from a closed instance pool.");
+      return;
+    }
+
+    CSOUND *Csound = NULL;
+    uint64_t opcodeIndexGeneration = CsoundOpcodeIndexGeneration.load();
+    {
+      std::lock_guard<std::mutex> lock(pool->mutex);
+      if (!pool->idleInstances.empty()) {
+        Csound = pool->idleInstances.back().first;
+        opcodeIndexGeneration = pool->idleInstances.back().second;
+        pool->idleInstances.pop_back();
+      }
+      pool->replenish();
+    }
+    // When there are no idle instances, create one on the main thread.
+    if (!Csound) {
+      pool->coldAcquisitionCount++;
+      Csound = pool->newInstance();
+      if (!Csound) {
+        info.GetReturnValue().SetNull();
+        return;
+      }
+    }
+
+    v8::Local<v8::Object> proxy = Nan::NewInstance(Nan::New(CSOUNDProxyConstructor)).ToLocalChecked();
+    CSOUNDWrapper *wrapper = Nan::ObjectWrap::Unwrap<CSOUNDWrapper>(proxy);
+    findInstrumentNodeType(Csound);
+    csoundSetHostData(Csound, wrapper);
+    wrapper->Csound = Csound;
+    wrapper->hostData.Reset(info[0]);
+    wrapper->opcodeIndexGeneration = opcodeIndexGeneration;
+    for (const std::string &option : pool->options) {
+      if (option.find("opcode-lib") != std::string::npos)
+        wrapper->noteOpcodesMayBeDefined();
+    }
+    info.GetReturnValue().Set(proxy);
+
+    double milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+    pool->acquisitionCount++;
+    pool->totalAcquisitionMilliseconds += milliseconds;
+    pool->maxAcquisitionMilliseconds = std::max(pool->maxAcquisitionMilliseconds, milliseconds);
+  }
+
+  static NAN_METHOD(release) {
+    CsoundInstancePoolWrapper *pool = Unwrap<CsoundInstancePoolWrapper>(info.This());
+    CSOUNDWrapper *wrapper = Nan::ObjectWrap::Unwrap<CSOUNDWrapper>(info[0].As<v8::Object>());
+    if (throwIfCompilingAsynchronously(wrapper, "release"))
+      return;
+    if (wrapper->isPerformingAsynchronously) {
+      Nan::ThrowError("Cannot release an instance of Csound while it’s performing.");
+      return;
+    }
+
+    CSOUND *Csound = wrapper->Csound;
+    wrapper->invalidateCsoundMemory();
+    // Callbacks survive csoundReset, so remove callbacks that refer to the
+    // wrapper before another wrapper reuses this instance.
+    csoundSetMessageCallback(Csound, NULL);
+    csoundSetFileOpenCallback(Csound, NULL);
+    csoundSetMakeGraphCallback(Csound, NULL);
+    csoundSetDrawGraphCallback(Csound, NULL);
+    csoundSetKillGraphCallback(Csound, NULL);
+    csoundSetHostData(Csound, NULL);
+    wrapper->Csound = NULL;
+
+    if (pool->isClosed) {
+      csoundDestroy(Csound);
+      return;
+    }
+    std::lock_guard<std::mutex> lock(pool->mutex);
+    pool->instancesToReset.push_back(Csound);
+    pool->workAvailable.notify_one();
+  }
+
+  static NAN_METHOD(close) {
+    Unwrap<CsoundInstancePoolWrapper>(info.This())->closePool();
+  }
+
+  static NAN_GETTER(idleCount) {
+    CsoundInstancePoolWrapper *pool = Unwrap<CsoundInstancePoolWrapper>(info.This());
+    std::lock_guard<std::mutex> lock(pool->mutex);
+    info.GetReturnValue().Set(Nan::New((uint32_t)pool->idleInstances.size()));
+  }
+
+  static NAN_GETTER(acquisitionStats) {
+    CsoundInstancePoolWrapper *pool = Unwrap<CsoundInstancePoolWrapper>(info.This());
+    v8::Local<v8::Object> stats = Nan::New<v8::Object>();
+    Nan::Set(stats, Nan::New("count").ToLocalChecked(), Nan::New(pool->acquisitionCount));
+    Nan::Set(stats, Nan::New("coldCount").ToLocalChecked(), Nan::New(pool->coldAcquisitionCount));
+    Nan::Set(stats, Nan::New("meanMilliseconds").ToLocalChecked(), Nan::New(pool->acquisitionCount > 0 ? pool->totalAcquisitionMilliseconds / pool->acquisitionCount : 0));
+    Nan::Set(stats, Nan::New("maxMilliseconds").ToLocalChecked(), Nan::New(pool->maxAcquisitionMilliseconds));
+    info.GetReturnValue().Set(stats);
+  }
+};
+
+static NAN_METHOD(CreateInstancePool) {
+  initializeCsound(0);
+
+  v8::Local<v8::Object> proxy = Nan::NewInstance(Nan::New(InstancePoolProxyConstructor)).ToLocalChecked();
+  CsoundInstancePoolWrapper *pool = Nan::ObjectWrap::Unwrap<CsoundInstancePoolWrapper>(proxy);
+  pool->size = 1;
+  if (info[0]->IsObject()) {
+    v8::Local<v8::Object> options = info[0].As<v8::Object>();
+    v8::Local<v8::Value> value = Nan::Get(options, Nan::New("size").ToLocalChecked()).ToLocalChecked();
+    if (!value->IsUndefined())
+      pool->size = Nan::To<uint32_t>(value).FromJust();
+    value = Nan::Get(options, Nan::New("options").ToLocalChecked()).ToLocalChecked();
+    if (value->IsArray()) {
+      v8::Local<v8::Array> array = value.As<v8::Array>();
+      for (uint32_t i = 0; i < array->Length(); i++) {
+        pool->options.push_back(*Nan::Utf8String(Nan::Get(array, i).ToLocalChecked()));
+      }
+    }
+  }
+  pool->start();
+  info.GetReturnValue().Set(proxy);
+}
+
+static NAN_METHOD(GetVersion) {
+  info.GetReturnValue().Set(Nan::New(csoundGetVersion()));
+}
+
+static NAN_METHOD(GetAPIVersion) {
+  info.GetReturnValue().Set(Nan::New(csoundGetAPIVersion()));
+}
+
+static Nan::Persistent<v8::Function> ORCTOKENProxyConstructor;
+struct ORCTOKENWrapper : public Nan::ObjectWrap {
+  ORCTOKEN *token;
+
+  static NAN_METHOD(New) {
+    (new ORCTOKENWrapper())->Wrap(info.This());
+    info.GetReturnValue().Set(info.This());
+  }
+
+  static ORCTOKEN *tokenFromPropertyCallbackInfo(Nan::NAN_GETTER_ARGS_TYPE info) {
+    return Unwrap<ORCTOKENWrapper>(info.This())->token;
+  }
+
+  static NAN_GETTER(type)   { info.GetReturnValue().Set(Nan::New(tokenFromPropertyCallbackInfo(info)->type)); }
+  static NAN_GETTER(value)  { info.GetReturnValue().Set(Nan::New(tokenFromPropertyCallbackInfo(info)->value)); }
+  static NAN_GETTER(fvalue) { info.GetReturnValue().Set(Nan::New(tokenFromPropertyCallbackInfo(info)->fvalue)); }
+  static NAN_GETTER(lexeme) { setReturnValueWithCString(info.GetReturnValue(), tokenFromPropertyCallbackInfo(info)->lexeme); }
+  static NAN_GETTER(optype) { setReturnValueWithCString(info.GetReturnValue(), tokenFromPropertyCallbackInfo(info)->optype); }
+
+  static NAN_GETTER(next) {
+    ORCTOKEN *token = tokenFromPropertyCallbackInfo(info)->next;
+    if (token) {
+      v8::Local<v8::Object> proxy = Nan::NewInstance(Nan::New(ORCTOKENProxyConstructor)).ToLocalChecked();
+      Unwrap<ORCTOKENWrapper>(proxy)->token = token;
+      info.GetReturnValue().Set(proxy);
+    } else {
+      info.GetReturnValue().SetNull();
+    }
+  }
+};
+
+static Nan::Persistent<v8::Function> TREEProxyConstructor;
+struct TREEWrapper : public Nan::ObjectWrap {
+  TREE *tree;
+
+  static NAN_METHOD(New) {
+    (new TREEWrapper())->Wrap(info.This());
+    info.GetReturnValue().Set(info.This());
+  }
+
+  static TREE *treeFromPropertyCallbackInfo(Nan::NAN_GETTER_ARGS_TYPE info) {
+    return Unwrap<TREEWrapper>(info.This())->tree;
+  }
+
+  static NAN_GETTER(value) {
+    ORCTOKEN *token = treeFromPropertyCallbackInfo(info)->value;
+    if (token) {
+      v8::Local<v8::Object> proxy = Nan::NewInstance(Nan::New(ORCTOKENProxyConstructor)).ToLocalChecked();
+      Unwrap<ORCTOKENWrapper>(proxy)->token = token;
+      info.GetReturnValue().Set(proxy);
+    } else {
+      info.GetReturnValue().SetNull();
+    }
+  }
+  static NAN_GETTER(type) { info.GetReturnValue().Set(Nan::New(treeFromPropertyCallbackInfo(info)->type)); }
+  static NAN_GETTER(rate) { info.GetReturnValue().Set(Nan::New(treeFromPropertyCallbackInfo(info)->rate)); }
+  static NAN_GETTER(len)  { info.GetReturnValue().Set(Nan::New(treeFromPropertyCallbackInfo(info)->len)); }
+  static NAN_GETTER(line) { info.GetReturnValue().Set(Nan::New(treeFromPropertyCallbackInfo(info)->line)); }
+  static NAN_GETTER(locn) { info.GetReturnValue().Set(Nan::New(static_cast<double>(treeFromPropertyCallbackInfo(info)->locn))); }
+
+  static void setPropertyCallbackInfoReturnValueWithTree(Nan::NAN_GETTER_ARGS_TYPE info, TREE *tree) {
+    if (tree) {
+      v8::Local<v8::Object> proxy = Nan::NewInstance(Nan::New(TREEProxyConstructor)).ToLocalChecked();
+      Unwrap<TREEWrapper>(proxy)->tree = tree;
+      info.GetReturnValue().Set(proxy);
+    } else {
+      info.GetReturnValue().SetNull();
+    }
+  }
+  static NAN_GETTER(left)  { setPropertyCallbackInfoReturnValueWithTree(info, treeFromPropertyCallbackInfo(info)->left); }
+  static NAN_GETTER(right) { setPropertyCallbackInfoReturnValueWithTree(info, treeFromPropertyCallbackInfo(info)->right); }
+  static NAN_GETTER(next)  { setPropertyCallbackInfoReturnValueWithTree(info, treeFromPropertyCallbackInfo(info)->next); }
+};
+
+static NAN_METHOD(ParseOrc) {
+  TREE *tree = csoundParseOrc(CsoundFromFunctionCallbackInfo(info), *Nan::Utf8String(info[1]));
+  if (tree) {
+    v8::Local<v8::Object> proxy = Nan::NewInstance(Nan::New(TREEProxyConstructor)).ToLocalChecked();
+    Nan::ObjectWrap::Unwrap<TREEWrapper>(proxy)->tree = tree;
+    info.GetReturnValue().Set(proxy);
+  } else {
+    info.GetReturnValue().SetNull();
+  }
+}
+
+static NAN_METHOD(CompileTree) {
+  Nan::ObjectWrap::Unwrap<CSOUNDWrapper>(info[0].As<v8::Object>())->noteOpcodesMayBeDefined();
+  info.GetReturnValue().Set(Nan::New(csoundCompileTree(CsoundFromFunctionCallbackInfo(info), Nan::ObjectWrap::Unwrap<TREEWrapper>(info[1].As<v8::Object>())->tree)));
+}
+
+static NAN_METHOD(DeleteTree) {
+  csoundDeleteTree(CsoundFromFunctionCallbackInfo(info), Nan::ObjectWrap::Unwrap<TREEWrapper>(info[1].As<v8::Object>())->tree);
+}
+
+// SerializeTree converts a whole syntax tree in one pass instead of creating a
+// TREE or ORCTOKEN object for each property access. The object and JSON formats
+// have the same properties as TREE and ORCTOKEN objects; the flat format stores
+// nodes in typed arrays with a table of strings. Nodes in a chain of next
+// properties are visited in a loop, so long orchestras don’t need a deep stack.
+static void appendJSONString(std::string &JSON, const char *string) {
+  if (!string) {
+    JSON += "null";
+    return;
+  }
+  JSON += '"';
+  for (const char *character = string; *character; character++) {
+    switch (*character) {
+      case '"':  JSON += "\\\""; break;
+      case '\\': JSON += "\\\\"; break;
+      case '\b': JSON += "\\b"; break;
+      case '\f': JSON += "\\f"; break;
+      case '\n': JSON += "\\n"; break;
+      case '\r': JSON += "\\r"; break;
+      case '\t': JSON += "\\t"; break;
+      default:
+        if ((unsigned char)*character < 0x20) {
+          char escape[7];
+          snprintf(escape, sizeof(escape), "\\u%04x", (unsigned char)*character);
+          JSON += escape;
+        } else {
+          JSON += *character;
+        }
+    }
+  }
+  JSON += '"';
 }
 
-static NAN_METHOD(GetVersion) {
-  info.GetReturnValue().Set(Nan::New(csoundGetVersion()));
+static void appendJSONNumber(std::string &JSON, double number) {
+  if (std::isfinite(number)) {
+    char string[32];
+    snprintf(string, sizeof(string), "%.17g", number);
+    JSON += string;
+  } else {
+    JSON += "null";
+  }
 }
 
-static NAN_METHOD(GetAPIVersion) {
-  info.GetReturnValue().Set(Nan::New(csoundGetAPIVersion()));
+static void appendJSONOfToken(std::string &JSON, ORCTOKEN *token) {
+  size_t tokenCount = 0;
+  for (; token; token = token->next, tokenCount++) {
+    JSON += "{\"type\":";
+    appendJSONNumber(JSON, token->type);
+    JSON += ",\"lexeme\":";
+    appendJSONString(JSON, token->lexeme);
+    JSON += ",\"value\":";
+    appendJSONNumber(JSON, token->value);
+    JSON += ",\"fvalue\":";
+    appendJSONNumber(JSON, token->fvalue);
+    JSON += ",\"optype\":";
+    appendJSONString(JSON, token->optype);
+    JSON += ",\"next\":";
+  }
+  JSON += "null";
+  JSON.append(tokenCount, '}');
+}
+
+static void appendJSONOfTree(std::string &JSON, TREE *tree) {
+  size_t treeCount = 0;
+  for (; tree; tree = tree->next, treeCount++) {
+    JSON += "{\"type\":";
+    appendJSONNumber(JSON, tree->type);
+    JSON += ",\"value\":";
+    appendJSONOfToken(JSON, tree->value);
+    JSON += ",\"rate\":";
+    appendJSONNumber(JSON, tree->rate);
+    JSON += ",\"len\":";
+    appendJSONNumber(JSON, tree->len);
+    JSON += ",\"line\":";
+    appendJSONNumber(JSON, tree->line);
+    JSON += ",\"locn\":";
+    appendJSONNumber(JSON, static_cast<double>(tree->locn));
+    JSON += ",\"left\":";
+    appendJSONOfTree(JSON, tree->left);
+    JSON += ",\"right\":";
+    appendJSONOfTree(JSON, tree->right);
+    JSON += ",\"next\":";
+  }
+  JSON += "null";
+  JSON.append(treeCount, '}');
+}
+
+struct CsoundTreeObjectSerializer {
+  v8::Local<v8::String> typeKey, valueKey, rateKey, lenKey, lineKey, locnKey, leftKey, rightKey, nextKey, lexemeKey, fvalueKey, optypeKey;
+
+  CsoundTreeObjectSerializer() :
+    typeKey(Nan::New("type").ToLocalChecked()), valueKey(Nan::New("value").ToLocalChecked()), rateKey(Nan::New("rate").ToLocalChecked()),
+    lenKey(Nan::New("len").ToLocalChecked()), lineKey(Nan::New("line").ToLocalChecked()), locnKey(Nan::New("locn").ToLocalChecked()),
+    leftKey(Nan::New("left").ToLocalChecked()), rightKey(Nan::New("right").ToLocalChecked()), nextKey(Nan::New("next").ToLocalChecked()),
+    lexemeKey(Nan::New("lexeme").ToLocalChecked()), fvalueKey(Nan::New("fvalue").ToLocalChecked()), optypeKey(Nan::New("optype").ToLocalChecked()) {}
+
+  static v8::Local<v8::Value> valueOfCString(const char *string) {
+    if (string)
+      return Nan::New(string).ToLocalChecked();
+    return Nan::Null();
+  }
+
+  v8::Local<v8::Value> objectOfToken(ORCTOKEN *token) {
+    v8::Local<v8::Value> firstObject = Nan::Null();
+    v8::Local<v8::Object> previousObject;
+    for (; token; token = token->next) {
+      v8::Local<v8::Object> object = Nan::New<v8::Object>();
+      Nan::Set(object, typeKey, Nan::New(token->type));
+      Nan::Set(object, lexemeKey, valueOfCString(token->lexeme));
+      Nan::Set(object, valueKey, Nan::New(token->value));
+      Nan::Set(object, fvalueKey, Nan::New(token->fvalue));
+      Nan::Set(object, optypeKey, valueOfCString(token->optype));
+      Nan::Set(object, nextKey, Nan::Null());
+      if (previousObject.IsEmpty())
+        firstObject = object;
+      else
+        Nan::Set(previousObject, nextKey, object);
+      previousObject = object;
+    }
+    return firstObject;
+  }
+
+  v8::Local<v8::Value> objectOfTree(TREE *tree) {
+    v8::Local<v8::Value> firstObject = Nan::Null();
+    v8::Local<v8::Object> previousObject;
+    for (; tree; tree = tree->next) {
+      v8::Local<v8::Object> object = Nan::New<v8::Object>();
+      Nan::Set(object, typeKey, Nan::New(tree->type));
+      Nan::Set(object, valueKey, objectOfToken(tree->value));
+      Nan::Set(object, rateKey, Nan::New(tree->rate));
+      Nan::Set(object, lenKey, Nan::New(tree->len));
+      Nan::Set(object, lineKey, Nan::New(tree->line));
+      Nan::Set(object, locnKey, Nan::New(static_cast<double>(tree->locn)));
+      Nan::Set(object, leftKey, objectOfTree(tree->left));
+      Nan::Set(object, rightKey, objectOfTree(tree->right));
+      Nan::Set(object, nextKey, Nan::Null());
+      if (previousObject.IsEmpty())
+        firstObject = object;
+      else
+        Nan::Set(previousObject, nextKey, object);
+      previousObject = object;
+    }
+    return firstObject;
+  }
+};
+
+// The flat format stores each node as nodeStride int32 values (type, rate, len,
+// line, token index, left index, right index, next index), and each token as
+// tokenStride int32 values (type, value, lexeme string index, optype string
+// index, next index). Missing nodes, tokens, and strings have index -1. The
+// root is node 0.
+struct CsoundTreeFlattener {
+  static const size_t nodeStride = 8;
+  static const size_t tokenStride = 5;
+
+  std::vector<int32_t> nodes;
+  std::vector<double> locations;
+  std::vector<int32_t> tokens;
+  std::vector<double> tokenFloatValues;
+  std::vector<std::string> strings;
+  std::unordered_map<std::string, int32_t> stringIndexes;
+
+  int32_t indexOfString(const char *string) {
+    if (!string)
+      return -1;
+    auto result = stringIndexes.emplace(string, (int32_t)strings.size());
+    if (result.second)
+      strings.push_back(string);
+    return result.first->second;
+  }
+
+  int32_t addToken(ORCTOKEN *token) {
+    int32_t firstIndex = -1;
+    size_t previousOffset = SIZE_MAX;
+    for (; token; token = token->next) {
+      int32_t index = (int32_t)tokenFloatValues.size();
+      if (previousOffset == SIZE_MAX)
+        firstIndex = index;
+      else
+        tokens[previousOffset + 4] = index;
+      previousOffset = tokens.size();
+      int32_t lexemeIndex = indexOfString(token->lexeme);
+      int32_t optypeIndex = indexOfString(token->optype);
+      tokens.insert(tokens.end(), {token->type, token->value, lexemeIndex, optypeIndex, -1});
+      tokenFloatValues.push_back(token->fvalue);
+    }
+    return firstIndex;
+  }
+
+  int32_t addTree(TREE *tree) {
+    int32_t firstIndex = -1;
+    size_t previousOffset = SIZE_MAX;
+    for (; tree; tree = tree->next) {
+      int32_t index = (int32_t)locations.size();
+      if (previousOffset == SIZE_MAX)
+        firstIndex = index;
+      else
+        nodes[previousOffset + 7] = index;
+      size_t offset = nodes.size();
+      previousOffset = offset;
+      nodes.insert(nodes.end(), {tree->type, tree->rate, tree->len, tree->line, -1, -1, -1, -1});
+      locations.push_back(static_cast<double>(tree->locn));
+      int32_t tokenIndex = addToken(tree->value);
+      nodes[offset + 4] = tokenIndex;
+      int32_t leftIndex = addTree(tree->left);
+      nodes[offset + 5] = leftIndex;
+      int32_t rightIndex = addTree(tree->right);
+      nodes[offset + 6] = rightIndex;
+    }
+    return firstIndex;
+  }
+
+  template <typename ArrayType, typename ElementType>
+  static v8::Local<ArrayType> newTypedArray(const std::vector<ElementType> &elements) {
+    v8::Local<v8::ArrayBuffer> buffer;
+    if (elements.empty()) {
+      buffer = v8::ArrayBuffer::New(v8::Isolate::GetCurrent(), 0);
+    } else {
+      size_t byteCount = sizeof(ElementType) * elements.size();
+      void *data = malloc(byteCount);
+      memcpy(data, elements.data(), byteCount);
+      buffer = newArrayBufferWithMallocedData(data, byteCount);
+    }
+    return ArrayType::New(buffer, 0, elements.size());
+  }
+
+  v8::Local<v8::Object> newObject() {
+    v8::Local<v8::Object> object = Nan::New<v8::Object>();
+    Nan::Set(object, Nan::New("nodes").ToLocalChecked(), newTypedArray<v8::Int32Array>(nodes));
+    Nan::Set(object, Nan::New("locations").ToLocalChecked(), newTypedArray<v8::Float64Array>(locations));
+    Nan::Set(object, Nan::New("tokens").ToLocalChecked(), newTypedArray<v8::Int32Array>(tokens));
+    Nan::Set(object, Nan::New("tokenFloatValues").ToLocalChecked(), newTypedArray<v8::Float64Array>(tokenFloatValues));
+    v8::Local<v8::Array> stringArray = Nan::New<v8::Array>(strings.size());
+    for (uint32_t i = 0; i < strings.size(); i++) {
+      Nan::Set(stringArray, i, Nan::New(strings[i]).ToLocalChecked());
+    }
+    Nan::Set(object, Nan::New("strings").ToLocalChecked(), stringArray);
+    Nan::Set(object, Nan::New("nodeStride").ToLocalChecked(), Nan::New((uint32_t)nodeStride));
+    Nan::Set(object, Nan::New("tokenStride").ToLocalChecked(), Nan::New((uint32_t)tokenStride));
+    return object;
+  }
+};
+
+static NAN_METHOD(SerializeTree) {
+  TREE *tree = Nan::ObjectWrap::Unwrap<TREEWrapper>(info[0].As<v8::Object>())->tree;
+
+  std::string formatName("object");
+  if (info[1]->IsObject()) {
+    v8::Local<v8::Value> value = Nan::Get(info[1].As<v8::Object>(), Nan::New("format").ToLocalChecked()).ToLocalChecked();
+    if (!value->IsUndefined())
+      formatName = *Nan::Utf8String(value);
+  }
+
+  if (formatName == "object") {
+    info.GetReturnValue().Set(CsoundTreeObjectSerializer().objectOfTree(tree));
+  } else if (formatName == "json") {
+    std::string JSON;
+    appendJSONOfTree(JSON, tree);
+    info.GetReturnValue().Set(Nan::New(JSON).ToLocalChecked());
+  } else if (formatName == "flat") {
+    CsoundTreeFlattener flattener;
+    flattener.addTree(tree);
+    info.GetReturnValue().Set(flattener.newObject());
+  } else {
+    Nan::ThrowTypeError("Format of SerializeTree must be 'object', 'json', or 'flat'.");
+  }
+}
+
+// A CsoundOpcodeIndex stores the opcode list of Csound in columns, with a table
+// of distinct strings and an index from opcode names (without suffixes like
+// the .k in oscili.k) to entries. Instances of Csound with the same plugins and
+// no user-defined opcodes have the same opcode list, so one index is shared by
+// these instances. Each index records the generation of plugins it was built
+// from (see CsoundOpcodeIndexGeneration), and the shared index is built only
+// from instances created or reset since the generation last changed. Instances
+// that may have defined opcodes, or that have older plugins, keep their own
+// index, which is rebuilt after they compile opcodes again.
+struct CsoundOpcodeIndex {
+  uint64_t generation;
+  std::vector<std::string> strings;
+  std::unordered_map<std::string, uint32_t> stringIndexes;
+  std::vector<uint32_t> nameIndexes;
+  std::vector<uint32_t> outypesIndexes;
+  std::vector<uint32_t> intypesIndexes;
+  std::vector<int32_t> flags;
+  std::unordered_map<std::string, std::vector<uint32_t>> entryIndexesByName;
+
+  uint32_t indexOfString(const char *string) {
+    auto result = stringIndexes.emplace(string ? string : "", (uint32_t)strings.size());
+    if (result.second)
+      strings.push_back(result.first->first);
+    return result.first->second;
+  }
+
+  CsoundOpcodeIndex(const opcodeListEntry *opcodeList, int opcodeCount, uint64_t generation) : generation(generation) {
+    for (int i = 0; i < opcodeCount; i++) {
+      const opcodeListEntry &entry = opcodeList[i];
+      nameIndexes.push_back(indexOfString(entry.opname));
+      outypesIndexes.push_back(indexOfString(entry.outypes));
+      intypesIndexes.push_back(indexOfString(entry.intypes));
+      flags.push_back(entry.flags);
+      entryIndexesByName[std::string(entry.opname, strcspn(entry.opname, "."))].push_back(i);
+    }
+  }
+
+  static std::shared_ptr<CsoundOpcodeIndex> newIndexOfCsound(CSOUND *Csound, uint64_t generation) {
+    opcodeListEntry *opcodeList;
+    int opcodeCount = csoundNewOpcodeList(Csound, &opcodeList);
+    if (opcodeCount < 0)
+      return NULL;
+    std::shared_ptr<CsoundOpcodeIndex> index = std::make_shared<CsoundOpcodeIndex>(opcodeList, opcodeCount, generation);
+    csoundDisposeOpcodeList(Csound, opcodeList);
+    return index;
+  }
+
+  size_t size() const {
+    return nameIndexes.size();
+  }
+};
+
+// Worker threads share these, so the shared index is only read or replaced
+// with the mutex locked, and callers keep a reference to the index they use.
+static std::shared_ptr<CsoundOpcodeIndex> CsoundSharedOpcodeIndex;
+static std::mutex CsoundSharedOpcodeIndexMutex;
+
+static std::shared_ptr<CsoundOpcodeIndex> opcodeIndexForWrapper(CSOUNDWrapper *wrapper) {
+  if (wrapper->mayDefineOpcodes || wrapper->opcodeIndexGeneration != CsoundOpcodeIndexGeneration.load()) {
+    if (!wrapper->opcodeIndex)
+      wrapper->opcodeIndex = CsoundOpcodeIndex::newIndexOfCsound(wrapper->Csound, wrapper->opcodeIndexGeneration);
+    return wrapper->opcodeIndex;
+  }
+
+  std::lock_guard<std::mutex> lock(CsoundSharedOpcodeIndexMutex);
+  if (!CsoundSharedOpcodeIndex || CsoundSharedOpcodeIndex->generation != wrapper->opcodeIndexGeneration)
+    CsoundSharedOpcodeIndex = CsoundOpcodeIndex::newIndexOfCsound(wrapper->Csound, wrapper->opcodeIndexGeneration);
+  return CsoundSharedOpcodeIndex;
+}
+
+// QueryTree answers common questions about a syntax tree in one native pass,
+// returning arrays of strings or numbers instead of TREE objects. Token types
+// of syntax tree nodes differ between versions of Csound, so instrument
+// definitions are recognized by comparing node types to the type of a parsed
+// instrument, and opcodes are recognized by name using the opcode list.
+enum CsoundTreeQuerySelection {
+  CsoundTreeQuerySelectionInstruments,
+  CsoundTreeQuerySelectionOpcodes,
+  CsoundTreeQuerySelectionChannels,
+  CsoundTreeQuerySelectionTables,
+  CsoundTreeQuerySelectionLines
+};
+
+struct CsoundTreeQuery {
+  CsoundTreeQuerySelection selection;
+  std::string instrumentName;
+  std::set<std::string> lexemes;
+  int instrumentNodeType;
+  std::shared_ptr<CsoundOpcodeIndex> opcodeIndex;
+
+  // Results, in the order found.
+  std::vector<std::string> names;
+  std::set<std::string> nameSet;
+  std::vector<std::string> readChannelNames;
+  std::set<std::string> readChannelNameSet;
+  std::vector<std::string> writtenChannelNames;
+  std::set<std::string> writtenChannelNameSet;
+  std::vector<int32_t> lines;
+
+  CsoundTreeQuery() : selection(CsoundTreeQuerySelectionOpcodes), instrumentNodeType(-1) {}
+
+  bool setUp(CSOUNDWrapper *wrapper, v8::Local<v8::Value> value) {
+    v8::Local<v8::Value> selectionValue = value;
+    if (value->IsObject()) {
+      v8::Local<v8::Object> query = value.As<v8::Object>();
+      selectionValue = Nan::Get(query, Nan::New("select").ToLocalChecked()).ToLocalChecked();
+      value = Nan::Get(query, Nan::New("instrument").ToLocalChecked()).ToLocalChecked();
+      if (!value->IsUndefined())
+        instrumentName = *Nan::Utf8String(value);
+      value = Nan::Get(query, Nan::New("lexemes").ToLocalChecked()).ToLocalChecked();
+      if (value->IsArray()) {
+        v8::Local<v8::Array> array = value.As<v8::Array>();
+        for (uint32_t i = 0; i < array->Length(); i++) {
+          lexemes.insert(*Nan::Utf8String(Nan::Get(array, i).ToLocalChecked()));
+        }
+      }
+    }
+
+    std::string selectionName(*Nan::Utf8String(selectionValue));
+    if (selectionName == "instruments") {
+      selection = CsoundTreeQuerySelectionInstruments;
+    } else if (selectionName == "opcodes") {
+      selection = CsoundTreeQuerySelectionOpcodes;
+    } else if (selectionName == "channels") {
+      selection = CsoundTreeQuerySelectionChannels;
+    } else if (selectionName == "tables") {
+      selection = CsoundTreeQuerySelectionTables;
+    } else if (selectionName == "lines") {
+      selection = CsoundTreeQuerySelectionLines;
+    } else {
+      Nan::ThrowTypeError("Query of QueryTree must select 'instruments', 'opcodes', 'channels', 'tables', or 'lines'.");
+      return false;
+    }
+
+    instrumentNodeType = CsoundInstrumentNodeType;
+    if (selection == CsoundTreeQuerySelectionOpcodes)
+      opcodeIndex = opcodeIndexForWrapper(wrapper);
+    return true;
+  }
+
+  static void addName(const std::string &name, std::vector<std::string> &names, std::set<std::string> &nameSet) {
+    if (nameSet.insert(name).second)
+      names.push_back(name);
+  }
+
+  static const char *lexemeOfTree(TREE *tree) {
+    return tree->value ? tree->value->lexeme : NULL;
+  }
+
+  static void collectLexemes(TREE *tree, std::vector<std::string> &lexemes) {
+    for (; tree; tree = tree->next) {
+      if (const char *lexeme = lexemeOfTree(tree))
+        lexemes.push_back(lexeme);
+      collectLexemes(tree->left, lexemes);
+      collectLexemes(tree->right, lexemes);
+    }
+  }
+
+  // Adds string literals in a subtree, without quotes, to a list of channels.
+  static void collectStrings(TREE *tree, std::vector<std::string> &names, std::set<std::string> &nameSet) {
+    for (; tree; tree = tree->next) {
+      const char *lexeme = lexemeOfTree(tree);
+      if (lexeme && lexeme[0] == '"') {
+        size_t length = strlen(lexeme);
+        addName(std::string(lexeme + 1, length > 1 && lexeme[length - 1] == '"' ? length - 2 : length - 1), names, nameSet);
+      }
+      collectStrings(tree->left, names, nameSet);
+      collectStrings(tree->right, names, nameSet);
+    }
+  }
+
+  // Table arguments of common opcodes, as zero-based argument positions.
+  struct TableArgument {
+    const char *opcodeName;
+    int position;
+  };
+
+  // Adds the table number or variable passed to an opcode that reads or writes
+  // a function table. Only arguments that are a single number or variable are
+  // added, not expressions.
+  void addTableArguments(const std::string &opcodeName, TREE *arguments) {
+    static const TableArgument tableArguments[] = {
+      {"oscil", 2}, {"oscili", 2}, {"oscil3", 2}, {"poscil", 2}, {"poscil3", 2},
+      {"oscilikt", 2}, {"loscil", 2}, {"loscil3", 2}, {"lposcil", 4},
+      {"buzz", 3}, {"gbuzz", 5}, {"foscil", 5}, {"foscili", 5},
+      {"table", 1}, {"tablei", 1}, {"table3", 1}, {"tab", 1}, {"tab_i", 1},
+      {"tablew", 2}, {"tabw", 2}, {"tabw_i", 2}, {"tableiw", 2},
+      {"tablecopy", 0}, {"tablecopy", 1},
+      {"ftlen", 0}, {"ftsr", 0}, {"ftchnls", 0}, {"ftlptim", 0}, {"nsamp", 0},
+      {"ftfree", 0}
+    };
+    for (const TableArgument &tableArgument : tableArguments) {
+      if (opcodeName != tableArgument.opcodeName)
+        continue;
+      TREE *argument = arguments;
+      for (int i = 0; argument && i < tableArgument.position; i++) {
+        argument = argument->next;
+      }
+      if (!argument || argument->left || argument->right)
+        continue;
+      if (const char *lexeme = lexemeOfTree(argument))
+        addName(lexeme, names, nameSet);
+    }
+  }
+
+  void visit(TREE *tree, bool isInSelectedInstrument) {
+    for (; tree; tree = tree->next) {
+      if (tree->type == instrumentNodeType) {
+        std::vector<std::string> instrumentNames;
+        collectLexemes(tree->left, instrumentNames);
+        if (selection == CsoundTreeQuerySelectionInstruments) {
+          for (const std::string &name : instrumentNames) {
+            addName(name, names, nameSet);
+          }
+          continue;
+        }
+        bool isSelected = instrumentName.empty() || std::find(instrumentNames.begin(), instrumentNames.end(), instrumentName) != instrumentNames.end();
+        visit(tree->right, isSelected);
+        continue;
+      }
+
+      if (isInSelectedInstrument)
+        visitNode(tree);
+      visit(tree->left, isInSelectedInstrument);
+      visit(tree->right, isInSelectedInstrument);
+    }
+  }
+
+  void visitNode(TREE *tree) {
+    const char *lexeme = lexemeOfTree(tree);
+    if (!lexeme)
+      return;
+    std::string name(lexeme);
+    switch (selection) {
+      case CsoundTreeQuerySelectionInstruments:
+        break;
+      case CsoundTreeQuerySelectionOpcodes:
+        if (opcodeIndex && opcodeIndex->entryIndexesByName.count(name))
+          addName(name, names, nameSet);
+        break;
+      case CsoundTreeQuerySelectionChannels:
+        if (name.compare(0, 6, "chnget") == 0 || name == "chnexport" || name == "chnparams" || name == "invalue") {
+          collectStrings(tree->right, readChannelNames, readChannelNameSet);
+        } else if (name.compare(0, 6, "chnset") == 0 || name == "chnmix" || name == "chnclear" || name == "outvalue") {
+          collectStrings(tree->right, writtenChannelNames, writtenChannelNameSet);
+        }
+        break;
+      case CsoundTreeQuerySelectionTables:
+        if (name == "ftgen" || name == "ftgenonce" || name == "ftgentmp") {
+          std::vector<std::string> tableNames;
+          collectLexemes(tree->left, tableNames);
+          for (const std::string &tableName : tableNames) {
+            addName(tableName, names, nameSet);
+          }
+        } else {
+          addTableArguments(name.substr(0, name.find_first_of(".:")), tree->right);
+        }
+        break;
+      case CsoundTreeQuerySelectionLines:
+        if (lexemes.count(name))
+          lines.push_back(tree->line);
+        break;
+    }
+  }
+
+  static v8::Local<v8::Array> newArray(const std::vector<std::string> &strings) {
+    v8::Local<v8::Array> array = Nan::New<v8::Array>(strings.size());
+    for (uint32_t i = 0; i < strings.size(); i++) {
+      Nan::Set(array, i, Nan::New(strings[i]).ToLocalChecked());
+    }
+    return array;
+  }
+
+  v8::Local<v8::Value> result() {
+    if (selection == CsoundTreeQuerySelectionChannels) {
+      v8::Local<v8::Object> object = Nan::New<v8::Object>();
+      Nan::Set(object, Nan::New("read").ToLocalChecked(), newArray(readChannelNames));
+      Nan::Set(object, Nan::New("written").ToLocalChecked(), newArray(writtenChannelNames));
+      return object;
+    }
+    if (selection == CsoundTreeQuerySelectionLines)
+      return CsoundTreeFlattener::newTypedArray<v8::Int32Array>(lines);
+    return newArray(names);
+  }
+};
+
+static NAN_METHOD(QueryTree) {
+  CSOUNDWrapper *wrapper = Nan::ObjectWrap::Unwrap<CSOUNDWrapper>(info[0].As<v8::Object>());
+  TREE *tree = Nan::ObjectWrap::Unwrap<TREEWrapper>(info[1].As<v8::Object>())->tree;
+  CsoundTreeQuery query;
+  if (!query.setUp(wrapper, info[2]))
+    return;
+  query.visit(tree, query.instrumentName.empty());
+  info.GetReturnValue().Set(query.result());
+}
+
+static NAN_METHOD(CompileOrc) {
+  CSOUNDWrapper *wrapper = Nan::ObjectWrap::Unwrap<CSOUNDWrapper>(info[0].As<v8::Object>());
+  if (throwIfCompilingAsynchronously(wrapper, "CompileOrc"))
+    return;
+  info.GetReturnValue().Set(wrapper->compileOrchestra(*Nan::Utf8String(info[1])));
+}
+
+static NAN_METHOD(SetParseTreeCache) {
+  CSOUNDWrapper *wrapper = Nan::ObjectWrap::Unwrap<CSOUNDWrapper>(info[0].As<v8::Object>());
+  if (wrapper->parseTreeCache) {
+    wrapper->parseTreeCache->clear(wrapper->Csound);
+    delete wrapper->parseTreeCache;
+    wrapper->parseTreeCache = NULL;
+  }
+  if (info[1]->IsObject()) {
+    v8::Local<v8::Object> options = info[1].As<v8::Object>();
+    v8::Local<v8::Value> value = Nan::Get(options, Nan::New("maxEntries").ToLocalChecked()).ToLocalChecked();
+    size_t maxEntryCount = value->IsUndefined() ? 16 : Nan::To<uint32_t>(value).FromJust();
+    value = Nan::Get(options, Nan::New("maxBytes").ToLocalChecked()).ToLocalChecked();
+    size_t maxByteCount = value->IsUndefined() ? 16 * 1024 * 1024 : Nan::To<uint32_t>(value).FromJust();
+    wrapper->parseTreeCache = new CsoundParseTreeCache(maxEntryCount, maxByteCount);
+  }
+}
+
+static NAN_METHOD(GetParseTreeCacheStats) {
+  CsoundParseTreeCache *cache = Nan::ObjectWrap::Unwrap<CSOUNDWrapper>(info[0].As<v8::Object>())->parseTreeCache;
+  if (!cache) {
+    info.GetReturnValue().SetNull();
+    return;
+  }
+  v8::Local<v8::Object> stats = Nan::New<v8::Object>();
+  Nan::Set(stats, Nan::New("hits").ToLocalChecked(), Nan::New(cache->hitCount));
+  Nan::Set(stats, Nan::New("misses").ToLocalChecked(), Nan::New(cache->missCount));
+  Nan::Set(stats, Nan::New("evictions").ToLocalChecked(), Nan::New(cache->evictionCount));
+  Nan::Set(stats, Nan::New("entries").ToLocalChecked(), Nan::New((uint32_t)cache->entries.size()));
+  Nan::Set(stats, Nan::New("bytes").ToLocalChecked(), Nan::New((double)cache->byteCount));
+  info.GetReturnValue().Set(stats);
 }
 
-static Nan::Persistent<v8::Function> ORCTOKENProxyConstructor;
-struct ORCTOKENWrapper : public Nan::ObjectWrap {
-  ORCTOKEN *token;
+static NAN_METHOD(EvalCode) {
+  CSOUNDWrapper *wrapper = Nan::ObjectWrap::Unwrap<CSOUNDWrapper>(info[0].As<v8::Object>());
+  Nan::Utf8String code(info[1]);
+  if (orchestraMayDefineOpcodes(*code))
+    wrapper->noteOpcodesMayBeDefined();
+  info.GetReturnValue().Set(Nan::New(csoundEvalCode(wrapper->Csound, *code)));
+}
+
+// Helper function to pass V8 values to csoundCompileArgs and csoundCompile.
+#define CSOUND_6_08_OR_LATER CS_VERSION >= 6 && CS_SUBVER >= 8
+#if CSOUND_6_08_OR_LATER
+#  define CSOUND_ARGUMENTS_TYPE const char **
+#else
+#  define CSOUND_ARGUMENTS_TYPE char **
+#endif
+static Nan::NAN_METHOD_RETURN_TYPE performCsoundCompileFunction(Nan::NAN_METHOD_ARGS_TYPE info, const char *functionName, int (*compileFunction)(CSOUND *, int, CSOUND_ARGUMENTS_TYPE)) {
+  CSOUND *Csound = idleCsoundFromFunctionCallbackInfo(info, functionName);
+  if (!Csound)
+    return;
+  Nan::ObjectWrap::Unwrap<CSOUNDWrapper>(info[0].As<v8::Object>())->noteOpcodesMayBeDefined();
+  v8::Local<v8::Array> array = info[1].As<v8::Array>();
+  uint32_t argumentCount = array->Length();
+  if (argumentCount > 0) {
+    char **arguments = (char **)malloc(sizeof(char *) * argumentCount);
+    for (uint32_t i = 0; i < argumentCount; i++) {
+      arguments[i] = strdup(*Nan::Utf8String(Nan::Get(array, i).ToLocalChecked()));
+    }
+    info.GetReturnValue().Set(Nan::New(compileFunction(Csound, argumentCount, (CSOUND_ARGUMENTS_TYPE)arguments)));
+    for (uint32_t i = 0; i < argumentCount; i++) {
+      free(arguments[i]);
+    }
+    free(arguments);
+  }
+}
+
+static NAN_METHOD(CompileArgs) {
+  performCsoundCompileFunction(info, "CompileArgs", csoundCompileArgs);
+}
+
+static NAN_METHOD(Start) {
+  CSOUND *Csound = idleCsoundFromFunctionCallbackInfo(info, "Start");
+  if (Csound)
+    info.GetReturnValue().Set(csoundStart(Csound));
+}
+
+static NAN_METHOD(Compile) {
+  performCsoundCompileFunction(info, "Compile", csoundCompile);
+}
+
+static NAN_METHOD(CompileCsd) {
+  CSOUND *Csound = idleCsoundFromFunctionCallbackInfo(info, "CompileCsd");
+  if (Csound) {
+    Nan::ObjectWrap::Unwrap<CSOUNDWrapper>(info[0].As<v8::Object>())->noteOpcodesMayBeDefined();
+    info.GetReturnValue().Set(Nan::New(csoundCompileCsd(Csound, *Nan::Utf8String(info[1]))));
+  }
+}
+
+// CsoundCompileWorker runs a compile function (like csoundCompileOrc or
+// csoundStart) on the libuv threadpool, and resolves a promise with the
+// returned status. Arguments are copied before the worker is queued, and
+// functions that change the instance of Csound throw an exception until the
+// worker finishes.
+struct CsoundCompileWorker : public Nan::AsyncWorker {
+  CSOUNDWrapper *wrapper;
+  std::function<int(CSOUNDWrapper *)> compileFunction;
+  int status;
+  Nan::Persistent<v8::Promise::Resolver> resolver;
+
+  CsoundCompileWorker(CSOUNDWrapper *wrapper, std::function<int(CSOUNDWrapper *)> compileFunction) : Nan::AsyncWorker(NULL, "csound-api:compile"), wrapper(wrapper), compileFunction(compileFunction), status(0) {}
+  ~CsoundCompileWorker() {
+    resolver.Reset();
+  }
+
+  void Execute() {
+    status = compileFunction(wrapper);
+  }
+
+  static NAN_METHOD(resolvePromise) {
+    info.Data().As<v8::Promise::Resolver>()->Resolve(Nan::GetCurrentContext(), info[0]).FromJust();
+  }
+
+  // The promise is resolved in the worker’s async scope (like a callback) so
+  // that Node.js runs the promise’s reactions afterward.
+  void HandleOKCallback() {
+    Nan::HandleScope scope;
+    wrapper->isCompilingAsynchronously = false;
+    v8::Local<v8::Function> function = Nan::GetFunction(Nan::New<v8::FunctionTemplate>(resolvePromise, Nan::New(resolver))).ToLocalChecked();
+    const int argc = 1;
+    v8::Local<v8::Value> argv[argc] = {Nan::New(status)};
+    async_resource->runInAsyncScope(Nan::GetCurrentContext()->Global(), function, argc, argv);
+  }
+};
+
+// Only CompileOrcAsync can run while Csound performs in the background, so
+// other functions pass false for canRunWhilePerforming.
+static void queueCompileWorker(Nan::NAN_METHOD_ARGS_TYPE info, const char *functionName, std::function<int(CSOUNDWrapper *)> compileFunction, bool canRunWhilePerforming = false) {
+  CSOUNDWrapper *wrapper = Nan::ObjectWrap::Unwrap<CSOUNDWrapper>(info[0].As<v8::Object>());
+  if (throwIfCompilingAsynchronously(wrapper, functionName))
+    return;
+  if (!canRunWhilePerforming && throwIfPerformingAsynchronously(wrapper, functionName))
+    return;
+
+  v8::Local<v8::Promise::Resolver> resolver = v8::Promise::Resolver::New(Nan::GetCurrentContext()).ToLocalChecked();
+  info.GetReturnValue().Set(resolver->GetPromise());
+
+  // While Csound performs in the background, compileOrchestra queues the
+  // orchestra to compile on the performance thread, so this doesn’t block.
+  if (wrapper->isPerformingAsynchronously) {
+    resolver->Resolve(Nan::GetCurrentContext(), Nan::New(compileFunction(wrapper))).FromJust();
+    return;
+  }
+
+  CsoundCompileWorker *worker = new CsoundCompileWorker(wrapper, compileFunction);
+  worker->resolver.Reset(resolver);
+  // Keep the Csound object alive until the worker finishes.
+  worker->SaveToPersistent("Csound", info[0]);
+  wrapper->isCompilingAsynchronously = true;
+  Nan::AsyncQueueWorker(worker);
+}
+
+static NAN_METHOD(CompileOrcAsync) {
+  std::string orchestra(*Nan::Utf8String(info[1]));
+  queueCompileWorker(info, "CompileOrcAsync", [orchestra](CSOUNDWrapper *wrapper) {
+    return wrapper->compileOrchestra(orchestra.c_str());
+  }, true);
+}
+
+static NAN_METHOD(CompileCsdAsync) {
+  std::string path(*Nan::Utf8String(info[1]));
+  queueCompileWorker(info, "CompileCsdAsync", [path](CSOUNDWrapper *wrapper) {
+    wrapper->noteOpcodesMayBeDefined();
+    return csoundCompileCsd(wrapper->Csound, path.c_str());
+  });
+}
+
+static Nan::NAN_METHOD_RETURN_TYPE queueCsoundCompileFunction(Nan::NAN_METHOD_ARGS_TYPE info, const char *functionName, int (*compileFunction)(CSOUND *, int, CSOUND_ARGUMENTS_TYPE)) {
+  std::vector<std::string> arguments;
+  v8::Local<v8::Array> array = info[1].As<v8::Array>();
+  for (uint32_t i = 0; i < array->Length(); i++) {
+    arguments.push_back(*Nan::Utf8String(Nan::Get(array, i).ToLocalChecked()));
+  }
+  queueCompileWorker(info, functionName, [arguments, compileFunction](CSOUNDWrapper *wrapper) {
+    wrapper->noteOpcodesMayBeDefined();
+    std::vector<char *> argumentPointers;
+    for (const std::string &argument : arguments) {
+      argumentPointers.push_back(const_cast<char *>(argument.c_str()));
+    }
+    return argumentPointers.empty() ? 0 : compileFunction(wrapper->Csound, argumentPointers.size(), (CSOUND_ARGUMENTS_TYPE)argumentPointers.data());
+  });
+}
+
+static NAN_METHOD(CompileArgsAsync) {
+  queueCsoundCompileFunction(info, "CompileArgsAsync", csoundCompileArgs);
+}
+
+static NAN_METHOD(CompileAsync) {
+  queueCsoundCompileFunction(info, "CompileAsync", csoundCompile);
+}
+
+static NAN_METHOD(StartAsync) {
+  queueCompileWorker(info, "StartAsync", [](CSOUNDWrapper *wrapper) {
+    return csoundStart(wrapper->Csound);
+  });
+}
+
+// By default, Csound performs in the background on the libuv threadpool, where
+// a real-time performance holds one of a few threads shared with file system,
+// DNS, and zlib work. CsoundPerformThreadOptions describes a dedicated thread
+// to use instead, optionally with real-time priority and CPU affinity.
+struct CsoundPerformThreadOptions {
+  bool usesDedicatedThread;
+  int priority;
+  std::vector<uint32_t> CPUs;
+
+  CsoundPerformThreadOptions() : usesDedicatedThread(false), priority(0) {}
+
+  void setUp(v8::Local<v8::Value> value) {
+    if (!value->IsObject())
+      return;
+    v8::Local<v8::Object> options = value.As<v8::Object>();
+    value = Nan::Get(options, Nan::New("dedicatedThread").ToLocalChecked()).ToLocalChecked();
+    usesDedicatedThread = Nan::To<bool>(value).FromJust();
+    value = Nan::Get(options, Nan::New("priority").ToLocalChecked()).ToLocalChecked();
+    if (!value->IsUndefined()) {
+      usesDedicatedThread = true;
+      priority = Nan::To<int32_t>(value).FromJust();
+    }
+    value = Nan::Get(options, Nan::New("cpus").ToLocalChecked()).ToLocalChecked();
+    if (value->IsArray()) {
+      usesDedicatedThread = true;
+      v8::Local<v8::Array> array = value.As<v8::Array>();
+      for (uint32_t i = 0; i < array->Length(); i++) {
+        CPUs.push_back(Nan::To<uint32_t>(Nan::Get(array, i).ToLocalChecked()).FromJust());
+      }
+    }
+  }
+
+  // Called on the dedicated thread. When the process isn’t allowed to change
+  // the priority or affinity of the thread, Csound performs anyway, and a
+  // warning is sent to Csound’s message callbacks.
+  void apply(CSOUND *Csound) const {
+#ifdef _WIN32
+    if (priority > 0 && !SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_TIME_CRITICAL))
+      csoundMessageS(Csound, CSOUNDMSG_WARNING, "could not set real-time priority of performance thread\n");
+    if (!CPUs.empty()) {
+      DWORD_PTR mask = 0;
+      for (uint32_t CPU : CPUs) {
+        if (CPU < sizeof(mask) * 8)
+          mask |= (DWORD_PTR)1 << CPU;
+      }
+      if (!SetThreadAffinityMask(GetCurrentThread(), mask))
+        csoundMessageS(Csound, CSOUNDMSG_WARNING, "could not set CPU affinity of performance thread\n");
+    }
+#else
+    if (priority > 0) {
+      sched_param parameters;
+      parameters.sched_priority = std::min(std::max(priority, sched_get_priority_min(SCHED_FIFO)), sched_get_priority_max(SCHED_FIFO));
+      int error = pthread_setschedparam(pthread_self(), SCHED_FIFO, &parameters);
+      if (error)
+        csoundMessageS(Csound, CSOUNDMSG_WARNING, "could not set real-time priority of performance thread: %s\n", strerror(error));
+    }
+    if (!CPUs.empty()) {
+#ifdef __linux__
+      cpu_set_t set;
+      CPU_ZERO(&set);
+      for (uint32_t CPU : CPUs) {
+        if (CPU < CPU_SETSIZE)
+          CPU_SET(CPU, &set);
+      }
+      int error = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+      if (error)
+        csoundMessageS(Csound, CSOUNDMSG_WARNING, "could not set CPU affinity of performance thread: %s\n", strerror(error));
+#else
+      csoundMessageS(Csound, CSOUNDMSG_WARNING, "CPU affinity of performance threads is not supported on this platform\n");
+#endif
+    }
+#endif
+  }
+};
+
+// CsoundPerformThread runs an AsyncWorker like Nan::AsyncQueueWorker does, but
+// on its own thread. When the worker finishes, the thread is joined and the
+// worker completes on the main thread.
+struct CsoundPerformThread {
+  uv_async_t handle;
+  std::thread thread;
+  Nan::AsyncWorker *worker;
+
+  static void asyncCallback(uv_async_t *handle) {
+    CsoundPerformThread *performThread = (CsoundPerformThread *)handle->data;
+    performThread->thread.join();
+    performThread->worker->WorkComplete();
+    performThread->worker->Destroy();
+    uv_close((uv_handle_t *)handle, [](uv_handle_t *handle) { delete (CsoundPerformThread *)handle->data; });
+  }
+
+  static void queueWorker(Nan::AsyncWorker *worker, CSOUND *Csound, const CsoundPerformThreadOptions &options) {
+    if (!options.usesDedicatedThread) {
+      Nan::AsyncQueueWorker(worker);
+      return;
+    }
+
+    CsoundPerformThread *performThread = new CsoundPerformThread();
+    performThread->worker = worker;
+    assert(uv_async_init(uv_default_loop(), &performThread->handle, asyncCallback) == 0);
+    performThread->handle.data = performThread;
+    performThread->thread = std::thread([performThread, Csound, options] {
+      options.apply(Csound);
+      performThread->worker->Execute();
+      uv_async_send(&performThread->handle);
+    });
+  }
+};
+
+struct CsoundPerformWorker : public Nan::AsyncWorker {
+  CSOUNDWrapper *wrapper;
+  int result;
+
+  CsoundPerformWorker(CSOUNDWrapper *wrapper, Nan::Callback *callback) : Nan::AsyncWorker(callback), wrapper(wrapper) {}
+  ~CsoundPerformWorker() {};
+
+  void Execute() {
+    while (!(result = wrapper->performKsmps())) {
+      if (wrapper->runQueuedCalls()) {
+        result = 0;
+        break;
+      }
+      if (raisedSignal)
+        break;
+    }
+  }
+
+  void HandleOKCallback() {
+    Nan::HandleScope scope;
+
+    wrapper->CsoundDidPerformAsynchronously();
+
+    const int argc = 1;
+    v8::Local<v8::Value> argv[argc];
+    argv[0] = Nan::New(result);
+    callback->Call(argc, argv, async_resource);
 
-  static NAN_METHOD(New) {
-    (new ORCTOKENWrapper())->Wrap(info.This());
-    info.GetReturnValue().Set(info.This());
+    performingCsoundInstanceCount = performingCsoundInstanceCount - 1;
+    if (performingCsoundInstanceCount == 0 && raisedSignal != 0)
+      raise(raisedSignal);
   }
+};
 
-  static ORCTOKEN *tokenFromPropertyCallbackInfo(Nan::NAN_GETTER_ARGS_TYPE info) {
-    return Unwrap<ORCTOKENWrapper>(info.This())->token;
+static NAN_METHOD(PerformAsync) {
+  if (!info[1]->IsFunction()) {
+    Nan::ThrowTypeError("Argument 2 of PerformAsync must be a function.");
+    return;
   }
 
-  static NAN_GETTER(type)   { info.GetReturnValue().Set(Nan::New(tokenFromPropertyCallbackInfo(info)->type)); }
-  static NAN_GETTER(value)  { info.GetReturnValue().Set(Nan::New(tokenFromPropertyCallbackInfo(info)->value)); }
-  static NAN_GETTER(fvalue) { info.GetReturnValue().Set(Nan::New(tokenFromPropertyCallbackInfo(info)->fvalue)); }
-  static NAN_GETTER(lexeme) { setReturnValueWithCString(info.GetReturnValue(), tokenFromPropertyCallbackInfo(info)->lexeme); }
-  static NAN_GETTER(optype) { setReturnValueWithCString(info.GetReturnValue(), tokenFromPropertyCallbackInfo(info)->optype); }
+  CSOUNDWrapper *wrapper = Nan::ObjectWrap::Unwrap<CSOUNDWrapper>(info[0].As<v8::Object>());
+  if (throwIfCompilingAsynchronously(wrapper, "PerformAsync"))
+    return;
+  CsoundPerformThreadOptions threadOptions;
+  threadOptions.setUp(info[2]);
 
-  static NAN_GETTER(next) {
-    ORCTOKEN *token = tokenFromPropertyCallbackInfo(info)->next;
-    if (token) {
-      v8::Local<v8::Object> proxy = Nan::NewInstance(Nan::New(ORCTOKENProxyConstructor)).ToLocalChecked();
-      Unwrap<ORCTOKENWrapper>(proxy)->token = token;
-      info.GetReturnValue().Set(proxy);
-    } else {
-      info.GetReturnValue().SetNull();
+  wrapper->CsoundWillPerformAsynchronously();
+
+  CsoundPerformThread::queueWorker(new CsoundPerformWorker(wrapper, new Nan::Callback(info[1].As<v8::Function>())), wrapper->Csound, threadOptions);
+}
+
+// A CsoundRenderBuffer collects the output of each control period of a
+// performance in a buffer that grows geometrically. When the performance
+// finishes, the buffer is passed to JavaScript as a typed array without
+// copying.
+struct CsoundRenderBuffer {
+  bool rendersDoubles;
+  size_t initialFrameCount;
+  size_t maxFrameCount;
+  char *samples;
+  size_t sampleCapacity;
+  size_t sampleCount;
+  uint32_t reallocationCount;
+  uint32_t channelCount;
+  MYFLT sampleRate;
+  double milliseconds;
+
+  CsoundRenderBuffer() : rendersDoubles(true), initialFrameCount(0), maxFrameCount(SIZE_MAX), samples(NULL), sampleCapacity(0), sampleCount(0), reallocationCount(0), channelCount(1), sampleRate(0), milliseconds(0) {}
+  ~CsoundRenderBuffer() {
+    free(samples);
+  }
+
+  // Sets properties of the buffer from JavaScript options. This throws an
+  // exception and returns false if an option is invalid.
+  bool setUp(v8::Local<v8::Value> value, const char *functionName) {
+    if (!value->IsObject())
+      return true;
+    v8::Local<v8::Object> options = value.As<v8::Object>();
+    value = Nan::Get(options, Nan::New("format").ToLocalChecked()).ToLocalChecked();
+    if (!value->IsUndefined()) {
+      std::string formatName(*Nan::Utf8String(value));
+      if (formatName == "float32") {
+        rendersDoubles = false;
+      } else if (formatName != "float64") {
+        Nan::ThrowTypeError((std::string("Format of ") + functionName + " must be 'float32' or 'float64'.").c_str());
+        return false;
+      }
     }
+    value = Nan::Get(options, Nan::New("frames").ToLocalChecked()).ToLocalChecked();
+    if (!value->IsUndefined())
+      initialFrameCount = Nan::To<uint32_t>(value).FromJust();
+    value = Nan::Get(options, Nan::New("maxFrames").ToLocalChecked()).ToLocalChecked();
+    if (!value->IsUndefined())
+      maxFrameCount = Nan::To<uint32_t>(value).FromJust();
+    return true;
   }
-};
 
-static Nan::Persistent<v8::Function> TREEProxyConstructor;
-struct TREEWrapper : public Nan::ObjectWrap {
-  TREE *tree;
+  size_t bytesPerSample() const {
+    return rendersDoubles ? sizeof(double) : sizeof(float);
+  }
 
-  static NAN_METHOD(New) {
-    (new TREEWrapper())->Wrap(info.This());
-    info.GetReturnValue().Set(info.This());
+  bool reserve(size_t capacity) {
+    if (capacity <= sampleCapacity)
+      return true;
+    char *newSamples = (char *)realloc(samples, bytesPerSample() * capacity);
+    if (!newSamples)
+      return false;
+    samples = newSamples;
+    sampleCapacity = capacity;
+    reallocationCount++;
+    return true;
   }
 
-  static TREE *treeFromPropertyCallbackInfo(Nan::NAN_GETTER_ARGS_TYPE info) {
-    return Unwrap<TREEWrapper>(info.This())->tree;
+  // Allocates the initial buffer for a started instance of Csound, with room
+  // for one second of output unless told otherwise.
+  bool prepare(CSOUND *Csound) {
+    channelCount = csoundGetNchnls(Csound);
+    sampleRate = csoundGetSr(Csound);
+    size_t frameCount = initialFrameCount > 0 ? initialFrameCount : (size_t)sampleRate;
+    bool didReserve = reserve(std::max(std::min(frameCount, maxFrameCount), (size_t)1) * channelCount);
+    reallocationCount = 0;
+    return didReserve;
   }
 
-  static NAN_GETTER(value) {
-    ORCTOKEN *token = treeFromPropertyCallbackInfo(info)->value;
-    if (token) {
-      v8::Local<v8::Object> proxy = Nan::NewInstance(Nan::New(ORCTOKENProxyConstructor)).ToLocalChecked();
-      Unwrap<ORCTOKENWrapper>(proxy)->token = token;
-      info.GetReturnValue().Set(proxy);
+  // Appends the output of a control period. This returns false when rendering
+  // should stop, setting result to CSOUND_MEMORY if the buffer can’t grow.
+  bool append(CSOUND *Csound, int &result) {
+    size_t blockSampleCount = csoundGetKsmps(Csound) * channelCount;
+    if (sampleCount + blockSampleCount > sampleCapacity && !reserve(std::max(sampleCount + blockSampleCount, 2 * sampleCapacity))) {
+      result = CSOUND_MEMORY;
+      return false;
+    }
+    MYFLT *spout = csoundGetSpout(Csound);
+    if (rendersDoubles) {
+      std::copy(spout, spout + blockSampleCount, (double *)samples + sampleCount);
     } else {
-      info.GetReturnValue().SetNull();
+      std::copy(spout, spout + blockSampleCount, (float *)samples + sampleCount);
+    }
+    sampleCount += blockSampleCount;
+    if (sampleCount / channelCount >= maxFrameCount) {
+      sampleCount = maxFrameCount * channelCount;
+      return false;
     }
+    return true;
   }
-  static NAN_GETTER(type) { info.GetReturnValue().Set(Nan::New(treeFromPropertyCallbackInfo(info)->type)); }
-  static NAN_GETTER(rate) { info.GetReturnValue().Set(Nan::New(treeFromPropertyCallbackInfo(info)->rate)); }
-  static NAN_GETTER(len)  { info.GetReturnValue().Set(Nan::New(treeFromPropertyCallbackInfo(info)->len)); }
-  static NAN_GETTER(line) { info.GetReturnValue().Set(Nan::New(treeFromPropertyCallbackInfo(info)->line)); }
-  static NAN_GETTER(locn) { info.GetReturnValue().Set(Nan::New(static_cast<double>(treeFromPropertyCallbackInfo(info)->locn))); }
 
-  static void setPropertyCallbackInfoReturnValueWithTree(Nan::NAN_GETTER_ARGS_TYPE info, TREE *tree) {
-    if (tree) {
-      v8::Local<v8::Object> proxy = Nan::NewInstance(Nan::New(TREEProxyConstructor)).ToLocalChecked();
-      Unwrap<TREEWrapper>(proxy)->tree = tree;
-      info.GetReturnValue().Set(proxy);
+  v8::Local<v8::Value> newTypedArray() {
+    v8::Local<v8::ArrayBuffer> buffer;
+    if (sampleCount > 0) {
+      // Shrink the buffer to fit before handing it to the ArrayBuffer.
+      char *fittedSamples = (char *)realloc(samples, bytesPerSample() * sampleCount);
+      if (fittedSamples)
+        samples = fittedSamples;
+      buffer = newArrayBufferWithMallocedData(samples, bytesPerSample() * sampleCount);
+      samples = NULL;
+      sampleCapacity = 0;
     } else {
-      info.GetReturnValue().SetNull();
+      buffer = v8::ArrayBuffer::New(v8::Isolate::GetCurrent(), 0);
     }
+    if (rendersDoubles)
+      return v8::Float64Array::New(buffer, 0, sampleCount);
+    return v8::Float32Array::New(buffer, 0, sampleCount);
+  }
+
+  v8::Local<v8::Object> newStats() {
+    return newStats(sampleCount / channelCount);
+  }
+
+  // Renders to files don’t fill the buffer, so their frame count is passed.
+  v8::Local<v8::Object> newStats(double frameCount) {
+    v8::Local<v8::Object> stats = Nan::New<v8::Object>();
+    Nan::Set(stats, Nan::New("frames").ToLocalChecked(), Nan::New(frameCount));
+    Nan::Set(stats, Nan::New("channels").ToLocalChecked(), Nan::New(channelCount));
+    Nan::Set(stats, Nan::New("milliseconds").ToLocalChecked(), Nan::New(milliseconds));
+    Nan::Set(stats, Nan::New("realtimeFactor").ToLocalChecked(), Nan::New(milliseconds > 0 && sampleRate > 0 ? frameCount / sampleRate * 1000 / milliseconds : 0));
+    Nan::Set(stats, Nan::New("reallocations").ToLocalChecked(), Nan::New(reallocationCount));
+    return stats;
   }
-  static NAN_GETTER(left)  { setPropertyCallbackInfoReturnValueWithTree(info, treeFromPropertyCallbackInfo(info)->left); }
-  static NAN_GETTER(right) { setPropertyCallbackInfoReturnValueWithTree(info, treeFromPropertyCallbackInfo(info)->right); }
-  static NAN_GETTER(next)  { setPropertyCallbackInfoReturnValueWithTree(info, treeFromPropertyCallbackInfo(info)->next); }
 };
 
-static NAN_METHOD(ParseOrc) {
-  TREE *tree = csoundParseOrc(CsoundFromFunctionCallbackInfo(info), *Nan::Utf8String(info[1]));
-  if (tree) {
-    v8::Local<v8::Object> proxy = Nan::NewInstance(Nan::New(TREEProxyConstructor)).ToLocalChecked();
-    Nan::ObjectWrap::Unwrap<TREEWrapper>(proxy)->tree = tree;
-    info.GetReturnValue().Set(proxy);
-  } else {
-    info.GetReturnValue().SetNull();
+// CsoundRenderWorker performs without waking the main thread until the
+// performance finishes.
+struct CsoundRenderWorker : public Nan::AsyncWorker {
+  CSOUNDWrapper *wrapper;
+  CsoundRenderBuffer renderBuffer;
+  int result;
+
+  CsoundRenderWorker(CSOUNDWrapper *wrapper, Nan::Callback *callback) : Nan::AsyncWorker(callback), wrapper(wrapper), result(0) {}
+
+  void Execute() {
+    std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+    CSOUND *Csound = wrapper->Csound;
+    while (!(result = wrapper->performKsmps())) {
+      if (!renderBuffer.append(Csound, result))
+        break;
+      if (wrapper->runQueuedCalls()) {
+        result = 0;
+        break;
+      }
+      if (raisedSignal)
+        break;
+    }
+    renderBuffer.milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count();
   }
-}
 
-static NAN_METHOD(CompileTree) {
-  info.GetReturnValue().Set(Nan::New(csoundCompileTree(CsoundFromFunctionCallbackInfo(info), Nan::ObjectWrap::Unwrap<TREEWrapper>(info[1].As<v8::Object>())->tree)));
-}
+  void HandleOKCallback() {
+    Nan::HandleScope scope;
 
-static NAN_METHOD(DeleteTree) {
-  csoundDeleteTree(CsoundFromFunctionCallbackInfo(info), Nan::ObjectWrap::Unwrap<TREEWrapper>(info[1].As<v8::Object>())->tree);
-}
+    wrapper->CsoundDidPerformAsynchronously();
 
-static NAN_METHOD(CompileOrc) {
-  CSOUNDWrapper *wrapper = Nan::ObjectWrap::Unwrap<CSOUNDWrapper>(info[0].As<v8::Object>());
-  info.GetReturnValue().Set(wrapper->eventHandler->handleCompileOrc(wrapper->Csound, *Nan::Utf8String(info[1])));
-}
+    const int argc = 3;
+    v8::Local<v8::Value> argv[argc] = {Nan::New(result), renderBuffer.newTypedArray(), renderBuffer.newStats()};
+    callback->Call(argc, argv, async_resource);
 
-static NAN_METHOD(EvalCode) {
-  info.GetReturnValue().Set(Nan::New(csoundEvalCode(CsoundFromFunctionCallbackInfo(info), *Nan::Utf8String(info[1]))));
-}
+    performingCsoundInstanceCount = performingCsoundInstanceCount - 1;
+    if (performingCsoundInstanceCount == 0 && raisedSignal != 0)
+      raise(raisedSignal);
+  }
+};
 
-// Helper function to pass V8 values to csoundCompileArgs and csoundCompile.
-#define CSOUND_6_08_OR_LATER CS_VERSION >= 6 && CS_SUBVER >= 8
-#if CSOUND_6_08_OR_LATER
-#  define CSOUND_ARGUMENTS_TYPE const char **
-#else
-#  define CSOUND_ARGUMENTS_TYPE char **
-#endif
-static Nan::NAN_METHOD_RETURN_TYPE performCsoundCompileFunction(Nan::NAN_METHOD_ARGS_TYPE info, int (*compileFunction)(CSOUND *, int, CSOUND_ARGUMENTS_TYPE)) {
-  v8::Local<v8::Array> array = info[1].As<v8::Array>();
-  uint32_t argumentCount = array->Length();
-  if (argumentCount > 0) {
-    char **arguments = (char **)malloc(sizeof(char *) * argumentCount);
-    for (uint32_t i = 0; i < argumentCount; i++) {
-      arguments[i] = strdup(*Nan::Utf8String(Nan::Get(array, i).ToLocalChecked()));
-    }
-    info.GetReturnValue().Set(Nan::New(compileFunction(CsoundFromFunctionCallbackInfo(info), argumentCount, (CSOUND_ARGUMENTS_TYPE)arguments)));
-    for (uint32_t i = 0; i < argumentCount; i++) {
-      free(arguments[i]);
-    }
-    free(arguments);
+static NAN_METHOD(RenderAsync) {
+  v8::Local<v8::Value> optionsValue = info[1];
+  v8::Local<v8::Value> callbackValue = info[2];
+  if (info[1]->IsFunction()) {
+    optionsValue = Nan::Undefined();
+    callbackValue = info[1];
+  }
+  if (!callbackValue->IsFunction()) {
+    Nan::ThrowTypeError("The last argument of RenderAsync must be a function.");
+    return;
   }
-}
 
-static NAN_METHOD(CompileArgs) {
-  performCsoundCompileFunction(info, csoundCompileArgs);
-}
+  CSOUNDWrapper *wrapper = Nan::ObjectWrap::Unwrap<CSOUNDWrapper>(info[0].As<v8::Object>());
+  if (throwIfCompilingAsynchronously(wrapper, "RenderAsync"))
+    return;
+  CsoundRenderWorker *worker = new CsoundRenderWorker(wrapper, new Nan::Callback(callbackValue.As<v8::Function>()));
+  if (!worker->renderBuffer.setUp(optionsValue, "RenderAsync")) {
+    delete worker;
+    return;
+  }
+  if (!worker->renderBuffer.prepare(wrapper->Csound)) {
+    delete worker;
+    Nan::ThrowError("RenderAsync could not allocate memory.");
+    return;
+  }
 
-static NAN_METHOD(Start) {
-  info.GetReturnValue().Set(csoundStart(CsoundFromFunctionCallbackInfo(info)));
-}
+  CsoundPerformThreadOptions threadOptions;
+  threadOptions.setUp(optionsValue);
 
-static NAN_METHOD(Compile) {
-  performCsoundCompileFunction(info, csoundCompile);
-}
+  wrapper->CsoundWillPerformAsynchronously();
 
-static NAN_METHOD(CompileCsd) {
-  info.GetReturnValue().Set(Nan::New(csoundCompileCsd(CsoundFromFunctionCallbackInfo(info), *Nan::Utf8String(info[1]))));
+  CsoundPerformThread::queueWorker(worker, wrapper->Csound, threadOptions);
 }
 
-enum CsoundEventType {
-  CsoundEventTypeCompileOrc,
-  CsoundEventTypeStop,
-  CsoundEventTypeReadScore,
-  CsoundEventTypeScoreEvent,
-  CsoundEventTypeInputMessage
+// A render pool owns threads that each reuse an instance of Csound to render
+// CSDs. Idle threads take the next job from a shared queue, so jobs are
+// balanced across threads, and each instance is reset between jobs instead of
+// being recreated. Finished jobs are passed back to the main thread through a
+// uv_async_t.
+struct CsoundRenderJob {
+  std::string CSDText;
+  std::string outputPath;
+  std::vector<std::string> options;
+  CsoundRenderBuffer renderBuffer;
+  Nan::Callback callback;
+  int result;
+  double frameCount;
+  std::vector<std::string> messages;
+
+  CsoundRenderJob() : result(0), frameCount(0) {}
 };
 
-struct CsoundEventCommand {
-  CsoundEventType type;
-  char *code;
-  char scoreEventType;
-  MYFLT *parameterFieldValues;
-  long parameterFieldCount;
+// Instances of Csound in a render pool keep only error and warning messages,
+// which are passed to the job’s callback.
+static void collectRenderJobMessage(CSOUND *Csound, int attributes, const char *format, va_list argumentList) {
+  static const size_t maxMessageCount = 256;
+  int type = attributes & CSOUNDMSG_TYPE_MASK;
+  if (type != CSOUNDMSG_ERROR && type != CSOUNDMSG_WARNING)
+    return;
+  CsoundRenderJob *job = (CsoundRenderJob *)csoundGetHostData(Csound);
+  if (!job || job->messages.size() >= maxMessageCount)
+    return;
+  char message[CsoundMessageFilter::maxCheckedLength];
+  va_list argumentListCopy;
+  va_copy(argumentListCopy, argumentList);
+  vsnprintf(message, sizeof(message), format, argumentListCopy);
+  va_end(argumentListCopy);
+  job->messages.push_back(message);
+}
 
-  bool execute(CSOUND *Csound) {
-    switch (type) {
-      case CsoundEventTypeCompileOrc:
-        csoundCompileOrc(Csound, code);
-        free(code);
-        break;
-      case CsoundEventTypeStop:
-        return true;
-      case CsoundEventTypeReadScore:
-        csoundReadScore(Csound, code);
-        free(code);
-        break;
-      case CsoundEventTypeScoreEvent:
-        csoundScoreEvent(Csound, scoreEventType, parameterFieldValues, parameterFieldCount);
-        if (parameterFieldValues)
-          free(parameterFieldValues);
-        break;
-      case CsoundEventTypeInputMessage:
-        csoundInputMessage(Csound, code);
-        free(code);
-        break;
-    }
+// Writes CSD text to a new file in the temporary directory, so that it can be
+// passed to csoundCompileArgs along with other command-line arguments.
+static bool writeTemporaryCSD(const std::string &CSDText, std::string &path) {
+  static std::atomic<uint32_t> fileCounter(0);
+  const char *directory = getenv("TMPDIR");
+  if (!directory)
+    directory = getenv("TEMP");
+  if (!directory)
+    directory = getenv("TMP");
+  if (!directory)
+    directory = "/tmp";
+  for (int attempt = 0; attempt < 16; attempt++) {
+    path = std::string(directory) + "/csound-api-" + std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id())) + "-" + std::to_string(std::chrono::steady_clock::now().time_since_epoch().count()) + "-" + std::to_string(fileCounter++) + ".csd";
+    // The x flag fails if the file exists.
+    FILE *file = fopen(path.c_str(), "wx");
+    if (!file)
+      continue;
+    bool didWrite = fwrite(CSDText.data(), 1, CSDText.size(), file) == CSDText.size();
+    if (fclose(file) == 0 && didWrite)
+      return true;
+    remove(path.c_str());
     return false;
   }
-};
+  return false;
+}
 
-struct CsoundAsynchronousEventHandler : public CsoundEventHandler {
-  boost::lockfree::queue<CsoundEventCommand> commandQueue;
+static Nan::Persistent<v8::Function> RenderPoolProxyConstructor;
+struct CsoundRenderPoolWrapper : public Nan::ObjectWrap {
+  std::vector<std::thread> threads;
+  std::mutex mutex;
+  std::condition_variable jobAvailable;
+  std::deque<CsoundRenderJob *> queuedJobs;
+  std::vector<CsoundRenderJob *> finishedJobs;
+  uint32_t pendingJobCounter;
+  bool isReferenced;
+  bool isClosed;
+  uv_async_t *handle;
 
-  CsoundAsynchronousEventHandler() : commandQueue(0) {}
+  static NAN_METHOD(New) {
+    (new CsoundRenderPoolWrapper())->Wrap(info.This());
+    info.GetReturnValue().Set(info.This());
+  }
 
-  int handleCompileOrc(CSOUND *Csound, char *orchestra) {
-    CsoundEventCommand command;
-    command.type = CsoundEventTypeCompileOrc;
-    command.code = strdup(orchestra);
-    commandQueue.push(command);
-    return CSOUND_SUCCESS;
+  static void asyncCallback(uv_async_t *handle) {
+    if (handle->data)
+      ((CsoundRenderPoolWrapper *)handle->data)->sendFinishedJobs();
   }
-  void handleStop(CSOUND *Csound) {
-    CsoundEventCommand command;
-    command.type = CsoundEventTypeStop;
-    commandQueue.push(command);
+
+  CsoundRenderPoolWrapper() : pendingJobCounter(0), isReferenced(false), isClosed(false) {
+    handle = new uv_async_t;
+    assert(uv_async_init(uv_default_loop(), handle, asyncCallback) == 0);
+    handle->data = this;
+    // Keep Node.js running only while jobs are pending.
+    uv_unref((uv_handle_t *)handle);
   }
-  void handleInputMessage(CSOUND *Csound, char *scoreStatement) {
-    CsoundEventCommand command;
-    command.type = CsoundEventTypeInputMessage;
-    command.code = strdup(scoreStatement);
-    commandQueue.push(command);
+  ~CsoundRenderPoolWrapper() {
+    closeQueue();
+    for (std::thread &thread : threads) {
+      thread.join();
+    }
+    handle->data = NULL;
+    uv_close((uv_handle_t *)handle, [](uv_handle_t *handle) { delete (uv_async_t *)handle; });
   }
-  int handleReadScore(CSOUND *Csound, char *score) {
-    CsoundEventCommand command;
-    command.type = CsoundEventTypeReadScore;
-    command.code = strdup(score);
-    commandQueue.push(command);
-    return CSOUND_SUCCESS;
+
+  void start(uint32_t threadCount) {
+    for (uint32_t i = 0; i < threadCount; i++) {
+      threads.emplace_back(&CsoundRenderPoolWrapper::run, this);
+    }
   }
-  int handleScoreEvent(CSOUND *Csound, char eventType, MYFLT *parameterFieldValues, long parameterFieldCount) {
-    CsoundEventCommand command;
-    command.type = CsoundEventTypeScoreEvent;
-    command.scoreEventType = eventType;
-    command.parameterFieldValues = parameterFieldValues;
-    command.parameterFieldCount = parameterFieldCount;
-    commandQueue.push(command);
-    return CSOUND_SUCCESS;
+
+  void closeQueue() {
+    std::lock_guard<std::mutex> lock(mutex);
+    isClosed = true;
+    jobAvailable.notify_all();
   }
 
-  bool CsoundDidPerformKsmps(CSOUND *Csound) {
-    CsoundEventCommand command;
-    while (commandQueue.pop(command)) {
-      if (command.execute(Csound))
-        return true;
+  // Called on pool threads.
+  void run() {
+    CSOUND *Csound = csoundCreate(NULL);
+    if (Csound)
+      csoundSetMessageCallback(Csound, collectRenderJobMessage);
+    while (true) {
+      CsoundRenderJob *job;
+      {
+        std::unique_lock<std::mutex> lock(mutex);
+        jobAvailable.wait(lock, [this] { return isClosed || !queuedJobs.empty(); });
+        if (queuedJobs.empty())
+          break;
+        job = queuedJobs.front();
+        queuedJobs.pop_front();
+      }
+
+      if (Csound) {
+        csoundSetHostData(Csound, job);
+        renderJob(Csound, job);
+        csoundSetHostData(Csound, NULL);
+        csoundReset(Csound);
+      } else {
+        job->result = CSOUND_MEMORY;
+      }
+
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        finishedJobs.push_back(job);
+      }
+      uv_async_send(handle);
     }
-    return false;
+    if (Csound)
+      csoundDestroy(Csound);
   }
-};
 
-struct CsoundPerformWorker : public Nan::AsyncWorker {
-  CSOUNDWrapper *wrapper;
-  int result;
+  static void renderJob(CSOUND *Csound, CsoundRenderJob *job) {
+    std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+    csoundSetMessageCallback(Csound, collectRenderJobMessage);
+    // Csound can’t set options after compiling, and command-line arguments take
+    // precedence over a CSD’s <CsOptions>, so the CSD is compiled from a file
+    // along with the job’s options.
+    int result = CSOUND_ERROR;
+    std::string path;
+    if (writeTemporaryCSD(job->CSDText, path)) {
+      std::vector<std::string> arguments = {"csound", job->outputPath.empty() ? "--nosound" : "--output=" + job->outputPath};
+      arguments.insert(arguments.end(), job->options.begin(), job->options.end());
+      arguments.push_back(path);
+      std::vector<char *> argumentPointers;
+      for (const std::string &argument : arguments) {
+        argumentPointers.push_back(const_cast<char *>(argument.c_str()));
+      }
+      result = csoundCompileArgs(Csound, argumentPointers.size(), (CSOUND_ARGUMENTS_TYPE)argumentPointers.data());
+      remove(path.c_str());
+    } else {
+      job->messages.push_back("Could not write CSD to a temporary file.");
+    }
+    if (result == CSOUND_SUCCESS)
+      result = csoundStart(Csound);
+    if (result == CSOUND_SUCCESS && job->outputPath.empty() && !job->renderBuffer.prepare(Csound))
+      result = CSOUND_MEMORY;
+    if (result == CSOUND_SUCCESS) {
+      while (!(result = csoundPerformKsmps(Csound))) {
+        if (job->outputPath.empty() && !job->renderBuffer.append(Csound, result))
+          break;
+        if (raisedSignal)
+          break;
+      }
+      job->frameCount = csoundGetCurrentTimeSamples(Csound);
+      job->renderBuffer.channelCount = csoundGetNchnls(Csound);
+      job->renderBuffer.sampleRate = csoundGetSr(Csound);
+    }
+    job->result = result;
+    job->renderBuffer.milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+  }
 
-  CsoundPerformWorker(CSOUNDWrapper *wrapper, Nan::Callback *callback) : Nan::AsyncWorker(callback), wrapper(wrapper) {}
-  ~CsoundPerformWorker() {};
+  // Called on the main thread.
+  void sendFinishedJobs() {
+    Nan::HandleScope scope;
+    Nan::AsyncResource resource("csound-api:callback");
 
-  void Execute() {
-    while (!(result = csoundPerformKsmps(wrapper->Csound))) {
-      if (wrapper->eventHandler->CsoundDidPerformKsmps(wrapper->Csound)) {
-        result = 0;
-        break;
+    std::vector<CsoundRenderJob *> jobs;
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      jobs.swap(finishedJobs);
+    }
+    for (CsoundRenderJob *job : jobs) {
+      v8::Local<v8::Value> output;
+      v8::Local<v8::Object> stats;
+      if (job->outputPath.empty()) {
+        stats = job->renderBuffer.newStats();
+        output = job->renderBuffer.newTypedArray();
+      } else {
+        stats = job->renderBuffer.newStats(job->frameCount);
+        output = Nan::New(job->outputPath).ToLocalChecked();
       }
-      if (raisedSignal)
-        break;
+      pendingJobCounter--;
+      performingCsoundInstanceCount = performingCsoundInstanceCount - 1;
+      v8::Local<v8::Array> messages = Nan::New<v8::Array>(job->messages.size());
+      for (uint32_t i = 0; i < job->messages.size(); i++) {
+        Nan::Set(messages, i, Nan::New(job->messages[i]).ToLocalChecked());
+      }
+      v8::Local<v8::Value> argv[] = {Nan::New(job->result), output, stats, messages};
+      job->callback.Call(4, argv, &resource);
+      delete job;
+    }
+    if (pendingJobCounter == 0 && isReferenced) {
+      isReferenced = false;
+      uv_unref((uv_handle_t *)handle);
+      Unref();
     }
+    if (performingCsoundInstanceCount == 0 && raisedSignal != 0)
+      raise(raisedSignal);
   }
 
-  void HandleOKCallback() {
-    Nan::HandleScope scope;
+  static NAN_METHOD(render) {
+    CsoundRenderPoolWrapper *pool = Unwrap<CsoundRenderPoolWrapper>(info.This());
+    v8::Local<v8::Value> optionsValue = info[1];
+    v8::Local<v8::Value> callbackValue = info[2];
+    if (info[1]->IsFunction()) {
+      optionsValue = Nan::Undefined();
+      callbackValue = info[1];
+    }
+    if (!callbackValue->IsFunction()) {
+      Nan::ThrowTypeError("The last argument of render must be a function.");
+      return;
+    }
+    if (pool->isClosed) {
+      Nan::ThrowError("Cannot render after closing a render pool.");
+      return;
+    }
+
+    CsoundRenderJob *job = new CsoundRenderJob();
+    job->CSDText = *Nan::Utf8String(info[0]);
+    if (!job->renderBuffer.setUp(optionsValue, "render")) {
+      delete job;
+      return;
+    }
+    if (optionsValue->IsObject()) {
+      v8::Local<v8::Object> options = optionsValue.As<v8::Object>();
+      v8::Local<v8::Value> value = Nan::Get(options, Nan::New("output").ToLocalChecked()).ToLocalChecked();
+      if (!value->IsUndefined())
+        job->outputPath = *Nan::Utf8String(value);
+      value = Nan::Get(options, Nan::New("options").ToLocalChecked()).ToLocalChecked();
+      if (value->IsArray()) {
+        v8::Local<v8::Array> array = value.As<v8::Array>();
+        for (uint32_t i = 0; i < array->Length(); i++) {
+          job->options.push_back(*Nan::Utf8String(Nan::Get(array, i).ToLocalChecked()));
+        }
+      }
+    }
+    job->callback.Reset(callbackValue.As<v8::Function>());
+
+    if (!pool->isReferenced) {
+      pool->isReferenced = true;
+      uv_ref((uv_handle_t *)pool->handle);
+      pool->Ref();
+    }
+    pool->pendingJobCounter++;
+    performingCsoundInstanceCount = performingCsoundInstanceCount + 1;
 
-    wrapper->eventHandler->CsoundDidPerformKsmps(wrapper->Csound);
-    delete wrapper->eventHandler;
-    wrapper->eventHandler = new CsoundSynchronousEventHandler();
+    std::lock_guard<std::mutex> lock(pool->mutex);
+    pool->queuedJobs.push_back(job);
+    pool->jobAvailable.notify_one();
+  }
 
-    const int argc = 1;
-    v8::Local<v8::Value> argv[argc];
-    argv[0] = Nan::New(result);
-    callback->Call(argc, argv, async_resource);
+  static NAN_METHOD(close) {
+    Unwrap<CsoundRenderPoolWrapper>(info.This())->closeQueue();
+  }
 
-    performingCsoundInstanceCount = performingCsoundInstanceCount - 1;
-    if (performingCsoundInstanceCount == 0 && raisedSignal != 0)
-      raise(raisedSignal);
+  static NAN_GETTER(threadCount) {
+    info.GetReturnValue().Set(Nan::New((uint32_t)Unwrap<CsoundRenderPoolWrapper>(info.This())->threads.size()));
   }
-};
 
-static NAN_METHOD(PerformAsync) {
-  if (!info[1]->IsFunction()) {
-    Nan::ThrowTypeError("Argument 2 of PerformAsync must be a function.");
-    return;
+  static NAN_GETTER(pendingJobCount) {
+    info.GetReturnValue().Set(Nan::New(Unwrap<CsoundRenderPoolWrapper>(info.This())->pendingJobCounter));
   }
+};
 
-  CSOUNDWrapper *wrapper = Nan::ObjectWrap::Unwrap<CSOUNDWrapper>(info[0].As<v8::Object>());
-  delete wrapper->eventHandler;
-  wrapper->eventHandler = new CsoundAsynchronousEventHandler();
+static NAN_METHOD(CreateRenderPool) {
+  initializeCsound(0);
 
-  performingCsoundInstanceCount = performingCsoundInstanceCount + 1;
+  uint32_t threadCount = std::thread::hardware_concurrency();
+  if (info[0]->IsObject()) {
+    v8::Local<v8::Value> value = Nan::Get(info[0].As<v8::Object>(), Nan::New("threads").ToLocalChecked()).ToLocalChecked();
+    if (!value->IsUndefined())
+      threadCount = Nan::To<uint32_t>(value).FromJust();
+  }
+  if (threadCount == 0)
+    threadCount = 1;
 
-  Nan::AsyncQueueWorker(new CsoundPerformWorker(wrapper, new Nan::Callback(info[1].As<v8::Function>())));
+  v8::Local<v8::Object> proxy = Nan::NewInstance(Nan::New(RenderPoolProxyConstructor)).ToLocalChecked();
+  Nan::ObjectWrap::Unwrap<CsoundRenderPoolWrapper>(proxy)->start(threadCount);
+  info.GetReturnValue().Set(proxy);
 }
 
 static NAN_METHOD(Perform) {
-  info.GetReturnValue().Set(csoundPerform(CsoundFromFunctionCallbackInfo(info)));
+  CSOUND *Csound = availableCsoundFromFunctionCallbackInfo(info, "Perform");
+  if (Csound)
+    info.GetReturnValue().Set(csoundPerform(Csound));
 }
 
-struct CsoundPerformKsmpsWorker : public Nan::AsyncProgressWorker {
+// When PerformKsmpsAsync is passed options, CsoundPerformKsmpsWorker calls the
+// control period function only every controlPeriodInterval control periods or
+// millisecondInterval milliseconds (whichever comes first), and passes it the
+// current sample time, score time, and values of selected control channels.
+// Otherwise, the control period function is called with no arguments after
+// every control period.
+struct CsoundPerformKsmpsWorker : public Nan::AsyncProgressWorkerBase<double> {
   Nan::Callback *progressCallback;
   CSOUNDWrapper *wrapper;
+  bool sendsProgressData;
+  uint32_t controlPeriodInterval;
+  double millisecondInterval;
+  std::vector<std::atomic<MYFLT> *> channels;
 
-  CsoundPerformKsmpsWorker(CSOUNDWrapper *wrapper, Nan::Callback *progressCallback, Nan::Callback *callback) : Nan::AsyncProgressWorker(callback), progressCallback(progressCallback), wrapper(wrapper) {}
+  CsoundPerformKsmpsWorker(CSOUNDWrapper *wrapper, Nan::Callback *progressCallback, Nan::Callback *callback) : Nan::AsyncProgressWorkerBase<double>(callback), progressCallback(progressCallback), wrapper(wrapper), sendsProgressData(false), controlPeriodInterval(1), millisecondInterval(0) {}
   ~CsoundPerformKsmpsWorker() {};
 
-  void Execute(const Nan::AsyncProgressWorker::ExecutionProgress& executionProgress) {
-    while (!csoundPerformKsmps(wrapper->Csound)) {
-      executionProgress.Signal();
-      if (wrapper->eventHandler->CsoundDidPerformKsmps(wrapper->Csound))
+  void Execute(const Nan::AsyncProgressWorkerBase<double>::ExecutionProgress& executionProgress) {
+    // The progress data is the sample time, the score time, and then the
+    // channel values.
+    std::vector<double> progress(2 + channels.size());
+    uint32_t controlPeriodCount = 0;
+    std::chrono::steady_clock::time_point progressTime = std::chrono::steady_clock::now();
+    while (!wrapper->performKsmps()) {
+      bool shouldSendProgress = ++controlPeriodCount >= controlPeriodInterval;
+      if (!shouldSendProgress && millisecondInterval > 0)
+        shouldSendProgress = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - progressTime).count() >= millisecondInterval;
+      if (shouldSendProgress) {
+        controlPeriodCount = 0;
+        if (millisecondInterval > 0)
+          progressTime = std::chrono::steady_clock::now();
+        if (sendsProgressData) {
+          progress[0] = csoundGetCurrentTimeSamples(wrapper->Csound);
+          progress[1] = csoundGetScoreTime(wrapper->Csound);
+          for (size_t i = 0; i < channels.size(); i++) {
+            progress[i + 2] = channels[i]->load(std::memory_order_relaxed);
+          }
+          executionProgress.Send(progress.data(), progress.size());
+        } else {
+          executionProgress.Signal();
+        }
+      }
+      if (wrapper->runQueuedCalls())
         break;
       if (raisedSignal)
         break;
     }
   }
 
-  void HandleProgressCallback(const char *data, size_t size) {
+  void HandleProgressCallback(const double *data, size_t count) {
     Nan::HandleScope scope;
-    progressCallback->Call(0, NULL, async_resource);
+    if (sendsProgressData && data) {
+      size_t channelCount = count - 2;
+      v8::Local<v8::Float64Array> values = v8::Float64Array::New(v8::ArrayBuffer::New(v8::Isolate::GetCurrent(), sizeof(double) * channelCount), 0, channelCount);
+      Nan::TypedArrayContents<double> contents(values);
+      std::copy(data + 2, data + count, *contents);
+      const int argc = 3;
+      v8::Local<v8::Value> argv[argc] = {Nan::New(data[0]), Nan::New(data[1]), values};
+      progressCallback->Call(argc, argv, async_resource);
+    } else {
+      progressCallback->Call(0, NULL, async_resource);
+    }
   }
 
   void WorkComplete() {
     Nan::HandleScope scope;
 
-    wrapper->eventHandler->CsoundDidPerformKsmps(wrapper->Csound);
-    delete wrapper->eventHandler;
-    wrapper->eventHandler = new CsoundSynchronousEventHandler();
+    wrapper->CsoundDidPerformAsynchronously();
 
-    Nan::AsyncProgressWorker::WorkComplete();
+    Nan::AsyncProgressWorkerBase<double>::WorkComplete();
 
     performingCsoundInstanceCount = performingCsoundInstanceCount - 1;
     if (performingCsoundInstanceCount == 0 && raisedSignal != 0)
@@ -716,16 +3950,50 @@ static NAN_METHOD(PerformKsmpsAsync) {
   }
 
   CSOUNDWrapper *wrapper = Nan::ObjectWrap::Unwrap<CSOUNDWrapper>(info[0].As<v8::Object>());
-  delete wrapper->eventHandler;
-  wrapper->eventHandler = new CsoundAsynchronousEventHandler();
+  if (throwIfCompilingAsynchronously(wrapper, "PerformKsmpsAsync"))
+    return;
+  CsoundPerformKsmpsWorker *worker = new CsoundPerformKsmpsWorker(wrapper, new Nan::Callback(info[1].As<v8::Function>()), new Nan::Callback(info[2].As<v8::Function>()));
+
+  v8::Local<v8::Value> value = info[3];
+  if (value->IsObject()) {
+    v8::Local<v8::Object> options = value.As<v8::Object>();
+    value = Nan::Get(options, Nan::New("controlPeriods").ToLocalChecked()).ToLocalChecked();
+    v8::Local<v8::Value> millisecondsValue = Nan::Get(options, Nan::New("milliseconds").ToLocalChecked()).ToLocalChecked();
+    v8::Local<v8::Value> channelsValue = Nan::Get(options, Nan::New("channels").ToLocalChecked()).ToLocalChecked();
+    worker->sendsProgressData = !value->IsUndefined() || !millisecondsValue->IsUndefined() || channelsValue->IsArray();
+    if (!value->IsUndefined())
+      worker->controlPeriodInterval = std::max(Nan::To<uint32_t>(value).FromJust(), (uint32_t)1);
+    else if (!millisecondsValue->IsUndefined())
+      worker->controlPeriodInterval = UINT32_MAX;
+    if (!millisecondsValue->IsUndefined())
+      worker->millisecondInterval = Nan::To<double>(millisecondsValue).FromJust();
+
+    if (channelsValue->IsArray()) {
+      v8::Local<v8::Array> names = channelsValue.As<v8::Array>();
+      for (uint32_t i = 0; i < names->Length(); i++) {
+        std::atomic<MYFLT> *channel = getControlChannelPointer(wrapper->Csound, *Nan::Utf8String(Nan::Get(names, i).ToLocalChecked()), CSOUND_CONTROL_CHANNEL | CSOUND_OUTPUT_CHANNEL);
+        if (!channel) {
+          delete worker;
+          Nan::ThrowError("Argument 4 of PerformKsmpsAsync must contain names of control channels.");
+          return;
+        }
+        worker->channels.push_back(channel);
+      }
+    }
+  }
 
-  performingCsoundInstanceCount = performingCsoundInstanceCount + 1;
+  CsoundPerformThreadOptions threadOptions;
+  threadOptions.setUp(info[3]);
 
-  Nan::AsyncQueueWorker(new CsoundPerformKsmpsWorker(wrapper, new Nan::Callback(info[1].As<v8::Function>()), new Nan::Callback(info[2].As<v8::Function>())));
+  wrapper->CsoundWillPerformAsynchronously();
+
+  CsoundPerformThread::queueWorker(worker, wrapper->Csound, threadOptions);
 }
 
 static NAN_METHOD(PerformKsmps) {
-  info.GetReturnValue().Set((bool)csoundPerformKsmps(CsoundFromFunctionCallbackInfo(info)));
+  CSOUND *Csound = availableCsoundFromFunctionCallbackInfo(info, "PerformKsmps");
+  if (Csound)
+    info.GetReturnValue().Set((bool)csoundPerformKsmps(Csound));
 }
 
 static NAN_METHOD(PerformBuffer) {
@@ -735,6 +4003,71 @@ static NAN_METHOD(PerformBuffer) {
 static NAN_METHOD(Stop) {
   CSOUNDWrapper *wrapper = Nan::ObjectWrap::Unwrap<CSOUNDWrapper>(info[0].As<v8::Object>());
   wrapper->eventHandler->handleStop(wrapper->Csound);
+  // Wake a performance thread waiting on an audio stream.
+  if (wrapper->outputStream)
+    wrapper->outputStream->CsoundDidStop();
+  if (wrapper->inputStream)
+    wrapper->inputStream->CsoundDidStop();
+}
+
+static NAN_METHOD(GetPerformanceStats) {
+  info.GetReturnValue().Set(Nan::ObjectWrap::Unwrap<CSOUNDWrapper>(info[0].As<v8::Object>())->performanceStats.newStats());
+}
+
+static NAN_METHOD(GetBindingCounters) {
+  info.GetReturnValue().Set(Nan::ObjectWrap::Unwrap<CSOUNDWrapper>(info[0].As<v8::Object>())->bindingCounters.newFloat64Array());
+}
+
+static NAN_METHOD(GetBindingCounterNames) {
+  v8::Local<v8::Array> names = Nan::New<v8::Array>(CsoundBindingCounterCount);
+  for (uint32_t i = 0; i < CsoundBindingCounterCount; i++) {
+    Nan::Set(names, i, Nan::New(CsoundBindingCounterKeys[i]).ToLocalChecked());
+  }
+  info.GetReturnValue().Set(names);
+}
+
+static NAN_METHOD(CreateOutputStream) {
+  if (!info[2]->IsFunction()) {
+    Nan::ThrowTypeError("Argument 3 of CreateOutputStream must be a function.");
+    return;
+  }
+
+  CSOUNDWrapper *wrapper = Nan::ObjectWrap::Unwrap<CSOUNDWrapper>(info[0].As<v8::Object>());
+  if (wrapper->isPerformingAsynchronously) {
+    Nan::ThrowError("Cannot create an output stream while Csound is performing.");
+    return;
+  }
+
+  v8::Local<v8::Object> proxy = Nan::NewInstance(Nan::New(OutputStreamProxyConstructor)).ToLocalChecked();
+  CsoundOutputStreamWrapper *stream = Nan::ObjectWrap::Unwrap<CsoundOutputStreamWrapper>(proxy);
+  stream->channelCount = csoundGetNchnls(wrapper->Csound);
+  if (!stream->setUp(wrapper->Csound, info[1], stream->channelCount, "CreateOutputStream"))
+    return;
+  stream->callback.Reset(info[2].As<v8::Function>());
+
+  wrapper->detachOutputStream();
+  wrapper->outputStream = stream;
+  wrapper->outputStreamObject.Reset(proxy);
+  info.GetReturnValue().Set(proxy);
+}
+
+static NAN_METHOD(CreateInputStream) {
+  CSOUNDWrapper *wrapper = Nan::ObjectWrap::Unwrap<CSOUNDWrapper>(info[0].As<v8::Object>());
+  if (wrapper->isPerformingAsynchronously) {
+    Nan::ThrowError("Cannot create an input stream while Csound is performing.");
+    return;
+  }
+
+  v8::Local<v8::Object> proxy = Nan::NewInstance(Nan::New(InputStreamProxyConstructor)).ToLocalChecked();
+  CsoundInputStreamWrapper *stream = Nan::ObjectWrap::Unwrap<CsoundInputStreamWrapper>(proxy);
+  stream->channelCount = csoundGetNchnlsInput(wrapper->Csound);
+  if (!stream->setUp(wrapper->Csound, info[1], stream->channelCount, "CreateInputStream"))
+    return;
+
+  wrapper->detachInputStream();
+  wrapper->inputStream = stream;
+  wrapper->inputStreamObject.Reset(proxy);
+  info.GetReturnValue().Set(proxy);
 }
 
 static NAN_METHOD(Cleanup) {
@@ -742,7 +4075,12 @@ static NAN_METHOD(Cleanup) {
 }
 
 static NAN_METHOD(Reset) {
-  csoundReset(CsoundFromFunctionCallbackInfo(info));
+  CSOUNDWrapper *wrapper = Nan::ObjectWrap::Unwrap<CSOUNDWrapper>(info[0].As<v8::Object>());
+  if (throwIfCompilingAsynchronously(wrapper, "Reset"))
+    return;
+  wrapper->invalidateCsoundMemory();
+  wrapper->opcodeIndexGeneration = CsoundOpcodeIndexGeneration.load();
+  csoundReset(wrapper->Csound);
 }
 
 static NAN_METHOD(GetSr) {
@@ -786,7 +4124,10 @@ static NAN_METHOD(SetHostData) {
 }
 
 static NAN_METHOD(SetOption) {
-  info.GetReturnValue().Set(Nan::New(csoundSetOption(CsoundFromFunctionCallbackInfo(info), *Nan::Utf8String(info[1]))));
+  Nan::Utf8String option(info[1]);
+  if (strstr(*option, "opcode-lib"))
+    Nan::ObjectWrap::Unwrap<CSOUNDWrapper>(info[0].As<v8::Object>())->noteOpcodesMayBeDefined();
+  info.GetReturnValue().Set(Nan::New(csoundSetOption(CsoundFromFunctionCallbackInfo(info), *option)));
 }
 
 static NAN_METHOD(GetDebug) {
@@ -860,10 +4201,21 @@ struct CsoundFileType {
   static NAN_GETTER(UnknownAudio) { info.GetReturnValue().Set(CSFTYPE_UNKNOWN_AUDIO); }
 };
 
+static NAN_METHOD(GetSpin) {
+  CSOUNDWrapper *wrapper = Nan::ObjectWrap::Unwrap<CSOUNDWrapper>(info[0].As<v8::Object>());
+  CSOUND *Csound = wrapper->Csound;
+  info.GetReturnValue().Set(wrapper->viewOfCsoundMemory(csoundGetSpin(Csound), csoundGetKsmps(Csound) * csoundGetNchnlsInput(Csound)));
+}
+
+static NAN_METHOD(GetSpout) {
+  CSOUNDWrapper *wrapper = Nan::ObjectWrap::Unwrap<CSOUNDWrapper>(info[0].As<v8::Object>());
+  CSOUND *Csound = wrapper->Csound;
+  info.GetReturnValue().Set(wrapper->viewOfCsoundMemory(csoundGetSpout(Csound), csoundGetKsmps(Csound) * csoundGetNchnls(Csound)));
+}
+
 static void CsoundFileOpenCallback(CSOUND *Csound, const char *path, int type, int isOpenForWriting, int isTemporary) {
   CsoundCallback<CsoundFileOpenCallbackArguments> *CsoundFileOpenCallbackObject = ((CSOUNDWrapper *)csoundGetHostData(Csound))->CsoundFileOpenCallbackObject;
-  CsoundFileOpenCallbackObject->argumentsQueue.push(CsoundFileOpenCallbackArguments::create(path, type, isOpenForWriting, isTemporary));
-  uv_async_send(&(CsoundFileOpenCallbackObject->handle));
+  CsoundFileOpenCallbackObject->push(CsoundFileOpenCallbackArguments::create(path, type, isOpenForWriting, isTemporary));
 }
 static CSOUND_CALLBACK_METHOD(FileOpen)
 
@@ -943,29 +4295,78 @@ struct CsoundMessageBackgroundColor {
   static NAN_GETTER(Mask)    { info.GetReturnValue().Set(CSOUNDMSG_BG_COLOR_MASK); }
 };
 
+// Message callbacks are either called once per message, or with batches of
+// messages when SetDefaultMessageCallback or SetMessageCallback is passed an
+// options object with a batch property that is true. Either way, messages are
+// filtered first.
+static void handleCsoundMessage(CsoundCallback<CsoundMessageCallbackArguments> *callbackObject, CsoundMessageBatch *batchObject, CsoundAtomicMessageFilter &filter, int attributes, const char *format, va_list argumentList) {
+  if (!filter.acceptsMessage(attributes, format, argumentList))
+    return;
+  if (batchObject) {
+    batchObject->addMessage(attributes, format, argumentList);
+  } else if (callbackObject) {
+    callbackObject->push(CsoundMessageCallbackArguments::create(attributes, format, argumentList));
+  }
+}
+
+// Helper function to set the message callback objects of SetMessageCallback
+// and SetDefaultMessageCallback.
+static bool setMessageCallbackObjects(v8::Local<v8::Value> function, v8::Local<v8::Value> options, CsoundCallback<CsoundMessageCallbackArguments> *&callbackObject, CsoundMessageBatch *&batchObject, CsoundAtomicMessageFilter &atomicFilter, CsoundBindingCounters *counters) {
+  CsoundMessageFilter *filter = new CsoundMessageFilter();
+  if (options->IsObject())
+    filter->setOptions(options.As<v8::Object>());
+  atomicFilter.set(filter);
+
+  if (callbackObject) {
+    callbackObject->close();
+    callbackObject = NULL;
+  }
+  if (batchObject) {
+    batchObject->close();
+    batchObject = NULL;
+  }
+
+  if (!function->IsFunction())
+    return false;
+
+  if (options->IsObject()) {
+    v8::Local<v8::Object> optionsObject = options.As<v8::Object>();
+    if (Nan::To<bool>(Nan::Get(optionsObject, Nan::New("batch").ToLocalChecked()).ToLocalChecked()).FromJust()) {
+      v8::Local<v8::Value> value = Nan::Get(optionsObject, Nan::New("maxBatchLength").ToLocalChecked()).ToLocalChecked();
+      size_t maxMessageCount = value->IsUndefined() ? 1024 : Nan::To<uint32_t>(value).FromJust();
+      value = Nan::Get(optionsObject, Nan::New("maxBatchBytes").ToLocalChecked()).ToLocalChecked();
+      size_t maxTextLength = value->IsUndefined() ? 65536 : Nan::To<uint32_t>(value).FromJust();
+      batchObject = new CsoundMessageBatch(function.As<v8::Function>(), std::max(maxMessageCount, (size_t)1), std::max(maxTextLength, (size_t)2));
+      return true;
+    }
+  }
+
+  callbackObject = new CsoundCallback<CsoundMessageCallbackArguments>(function.As<v8::Function>(), counters, CsoundBindingCounterMessageQueueDepth);
+  return true;
+}
+
 static CsoundCallback<CsoundMessageCallbackArguments> *CsoundDefaultMessageCallbackObject;
+static CsoundMessageBatch *CsoundDefaultMessageBatchObject;
+static CsoundAtomicMessageFilter CsoundDefaultMessageFilter;
 static void CsoundDefaultMessageCallback(CSOUND *Csound, int attributes, const char *format, va_list argumentList) {
-  CsoundDefaultMessageCallbackObject->argumentsQueue.push(CsoundMessageCallbackArguments::create(attributes, format, argumentList));
-  uv_async_send(&(CsoundDefaultMessageCallbackObject->handle));
+  handleCsoundMessage(CsoundDefaultMessageCallbackObject, CsoundDefaultMessageBatchObject, CsoundDefaultMessageFilter, attributes, format, argumentList);
 }
 static NAN_METHOD(SetDefaultMessageCallback) {
-  v8::Local<v8::Value> value = info[0];
-  if (value->IsFunction()) {
-    CsoundDefaultMessageCallbackObject = new CsoundCallback<CsoundMessageCallbackArguments>(value.As<v8::Function>());
+  csoundSetDefaultMessageCallback(NULL);
+  if (setMessageCallbackObjects(info[0], info[1], CsoundDefaultMessageCallbackObject, CsoundDefaultMessageBatchObject, CsoundDefaultMessageFilter, NULL))
     csoundSetDefaultMessageCallback(CsoundDefaultMessageCallback);
-  } else if (CsoundDefaultMessageCallbackObject) {
-    delete CsoundDefaultMessageCallbackObject;
-    CsoundDefaultMessageCallbackObject = NULL;
-    csoundSetDefaultMessageCallback(NULL);
-  }
 }
 
 static void CsoundMessageCallback(CSOUND *Csound, int attributes, const char *format, va_list argumentList) {
-  CsoundCallback<CsoundMessageCallbackArguments> *CsoundMessageCallbackObject = ((CSOUNDWrapper *)csoundGetHostData(Csound))->CsoundMessageCallbackObject;
-  CsoundMessageCallbackObject->argumentsQueue.push(CsoundMessageCallbackArguments::create(attributes, format, argumentList));
-  uv_async_send(&(CsoundMessageCallbackObject->handle));
+  CSOUNDWrapper *wrapper = (CSOUNDWrapper *)csoundGetHostData(Csound);
+  handleCsoundMessage(wrapper->CsoundMessageCallbackObject, wrapper->CsoundMessageBatchObject, wrapper->messageFilter, attributes, format, argumentList);
+}
+static NAN_METHOD(SetMessageCallback) {
+  CSOUNDWrapper *wrapper = Nan::ObjectWrap::Unwrap<CSOUNDWrapper>(info[0].As<v8::Object>());
+  csoundSetMessageCallback(wrapper->Csound, NULL);
+  if (setMessageCallbackObjects(info[1], info[2], wrapper->CsoundMessageCallbackObject, wrapper->CsoundMessageBatchObject, wrapper->messageFilter, &wrapper->bindingCounters))
+    csoundSetMessageCallback(wrapper->Csound, CsoundMessageCallback);
 }
-static CSOUND_CALLBACK_METHOD(Message)
 
 static NAN_METHOD(GetMessageLevel) {
   info.GetReturnValue().Set(Nan::New(csoundGetMessageLevel(CsoundFromFunctionCallbackInfo(info))));
@@ -1160,6 +4561,232 @@ static NAN_METHOD(SetControlChannel) {
   csoundSetControlChannel(CsoundFromFunctionCallbackInfo(info), *Nan::Utf8String(info[1]), Nan::To<double>(info[2]).FromJust());
 }
 
+// Helper function to get the samples of a typed array passed to
+// GetAudioChannel or SetAudioChannel. Csound reads or writes ksmps samples, so
+// this throws an exception and returns NULL if the array is too short.
+static MYFLT *audioChannelSamplesFromFunctionCallbackInfo(Nan::NAN_METHOD_ARGS_TYPE info, const char *functionName) {
+  v8::Local<v8::Value> value = info[2];
+  if (!isMYFLTArray(value)) {
+    Nan::ThrowTypeError((std::string("Argument 3 of ") + functionName + " must be a " MYFLT_ARRAY_NAME ".").c_str());
+    return NULL;
+  }
+  Nan::TypedArrayContents<MYFLT> samples(value);
+  if (samples.length() < csoundGetKsmps(CsoundFromFunctionCallbackInfo(info))) {
+    Nan::ThrowRangeError((std::string("Argument 3 of ") + functionName + " must have a length of at least ksmps.").c_str());
+    return NULL;
+  }
+  return *samples;
+}
+
+static NAN_METHOD(GetAudioChannel) {
+  MYFLT *samples = audioChannelSamplesFromFunctionCallbackInfo(info, "GetAudioChannel");
+  if (samples)
+    csoundGetAudioChannel(CsoundFromFunctionCallbackInfo(info), *Nan::Utf8String(info[1]), samples);
+}
+
+static NAN_METHOD(SetAudioChannel) {
+  MYFLT *samples = audioChannelSamplesFromFunctionCallbackInfo(info, "SetAudioChannel");
+  if (samples) {
+    CSOUNDWrapper *wrapper = Nan::ObjectWrap::Unwrap<CSOUNDWrapper>(info[0].As<v8::Object>());
+    wrapper->eventHandler->handleSetAudioChannel(wrapper->Csound, *Nan::Utf8String(info[1]), samples);
+  }
+}
+
+// This is a base class for JavaScript objects that store control channel
+// pointers obtained from a Csound object.
+struct CsoundChannelPointerWrapper : public Nan::ObjectWrap, public CsoundChannelPointerOwner {
+  bool isValid;
+  CSOUNDWrapper *CsoundWrapper;
+  // Keep the Csound object alive at least as long as this object.
+  Nan::Persistent<v8::Object> CsoundObject;
+
+  CsoundChannelPointerWrapper() : isValid(false), CsoundWrapper(NULL) {}
+  ~CsoundChannelPointerWrapper() {
+    if (CsoundWrapper)
+      CsoundWrapper->channelPointerOwners.erase(this);
+    CsoundObject.Reset();
+  }
+
+  void registerWithCsoundObject(v8::Local<v8::Object> CsoundObject) {
+    isValid = true;
+    CsoundWrapper = Unwrap<CSOUNDWrapper>(CsoundObject);
+    this->CsoundObject.Reset(CsoundObject);
+    CsoundWrapper->channelPointerOwners.insert(this);
+  }
+
+  void invalidateChannelPointers() {
+    isValid = false;
+  }
+
+  template <typename WrapperType>
+  static WrapperType *validWrapperFromObject(v8::Local<v8::Object> object) {
+    WrapperType *wrapper = Unwrap<WrapperType>(object);
+    if (wrapper->isValid)
+      return wrapper;
+    Nan::ThrowError("Channel pointers are invalid because their Csound object was reset or destroyed.");
+    return NULL;
+  }
+};
+
+static Nan::Persistent<v8::Function> ChannelHandleProxyConstructor;
+struct ChannelHandleWrapper : public CsoundChannelPointerWrapper {
+  std::atomic<MYFLT> *channel;
+
+  static NAN_METHOD(New) {
+    (new ChannelHandleWrapper())->Wrap(info.This());
+    info.GetReturnValue().Set(info.This());
+  }
+
+  static NAN_METHOD(get) {
+    ChannelHandleWrapper *wrapper = validWrapperFromObject<ChannelHandleWrapper>(info.This());
+    if (wrapper)
+      info.GetReturnValue().Set(Nan::New(wrapper->channel->load(std::memory_order_relaxed)));
+  }
+
+  static NAN_METHOD(set) {
+    ChannelHandleWrapper *wrapper = validWrapperFromObject<ChannelHandleWrapper>(info.This());
+    if (wrapper)
+      wrapper->channel->store(Nan::To<double>(info[0]).FromJust(), std::memory_order_relaxed);
+  }
+};
+
+// Helper function to get the type of a channel passed to GetChannelHandle or
+// GetChannelSet. This throws an exception and returns -1 if the type isn’t a
+// control channel type.
+static int controlChannelTypeFromValue(v8::Local<v8::Value> value, const char *functionName) {
+  if (value->IsUndefined())
+    return CSOUND_CONTROL_CHANNEL | CSOUND_INPUT_CHANNEL | CSOUND_OUTPUT_CHANNEL;
+  int type = Nan::To<int32_t>(value).FromJust();
+  if ((type & CSOUND_CHANNEL_TYPE_MASK) != CSOUND_CONTROL_CHANNEL) {
+    Nan::ThrowTypeError((std::string("Argument 3 of ") + functionName + " must specify a control channel.").c_str());
+    return -1;
+  }
+  return type;
+}
+
+static NAN_METHOD(GetChannelHandle) {
+  int type = controlChannelTypeFromValue(info[2], "GetChannelHandle");
+  if (type < 0)
+    return;
+
+  std::atomic<MYFLT> *channel = getControlChannelPointer(CsoundFromFunctionCallbackInfo(info), *Nan::Utf8String(info[1]), type);
+  if (!channel) {
+    info.GetReturnValue().SetNull();
+    return;
+  }
+
+  v8::Local<v8::Object> proxy = Nan::NewInstance(Nan::New(ChannelHandleProxyConstructor)).ToLocalChecked();
+  ChannelHandleWrapper *handle = Nan::ObjectWrap::Unwrap<ChannelHandleWrapper>(proxy);
+  handle->channel = channel;
+  handle->registerWithCsoundObject(info[0].As<v8::Object>());
+  info.GetReturnValue().Set(proxy);
+}
+
+static Nan::Persistent<v8::Function> ChannelSetProxyConstructor;
+static Nan::Persistent<v8::FunctionTemplate> ChannelSetTemplate;
+struct ChannelSetWrapper : public CsoundChannelPointerWrapper {
+  std::vector<std::atomic<MYFLT> *> channels;
+
+  static NAN_METHOD(New) {
+    (new ChannelSetWrapper())->Wrap(info.This());
+    info.GetReturnValue().Set(info.This());
+  }
+
+  static NAN_GETTER(length) {
+    info.GetReturnValue().Set(Nan::New((uint32_t)Unwrap<ChannelSetWrapper>(info.This())->channels.size()));
+  }
+};
+
+static NAN_METHOD(GetChannelSet) {
+  int type = controlChannelTypeFromValue(info[2], "GetChannelSet");
+  if (type < 0)
+    return;
+
+  CSOUND *Csound = CsoundFromFunctionCallbackInfo(info);
+  v8::Local<v8::Array> names = info[1].As<v8::Array>();
+  uint32_t channelCount = names->Length();
+  std::vector<std::atomic<MYFLT> *> channels(channelCount);
+  for (uint32_t i = 0; i < channelCount; i++) {
+    channels[i] = getControlChannelPointer(Csound, *Nan::Utf8String(Nan::Get(names, i).ToLocalChecked()), type);
+    if (!channels[i]) {
+      info.GetReturnValue().SetNull();
+      return;
+    }
+  }
+
+  v8::Local<v8::Object> proxy = Nan::NewInstance(Nan::New(ChannelSetProxyConstructor)).ToLocalChecked();
+  ChannelSetWrapper *channelSet = Nan::ObjectWrap::Unwrap<ChannelSetWrapper>(proxy);
+  channelSet->channels.swap(channels);
+  channelSet->registerWithCsoundObject(info[0].As<v8::Object>());
+  info.GetReturnValue().Set(proxy);
+}
+
+// SetControlChannels and GetControlChannels accept either a ChannelSet or an
+// array of channel names. When passed an array, these functions look up
+// channels by name once per call; a ChannelSet avoids even this. These
+// functions return CSOUND_SUCCESS, or CSOUND_ERROR if a channel name doesn’t
+// refer to a control channel.
+template <typename ChannelFunction>
+static void performControlChannelsFunction(Nan::NAN_METHOD_ARGS_TYPE info, const char *functionName, ChannelFunction channelFunction) {
+  v8::Local<v8::Value> value = info[2];
+  if (!isMYFLTArray(value)) {
+    Nan::ThrowTypeError((std::string("Argument 3 of ") + functionName + " must be a " MYFLT_ARRAY_NAME ".").c_str());
+    return;
+  }
+  Nan::TypedArrayContents<MYFLT> values(value);
+
+  v8::Local<v8::Object> channelsObject = info[1].As<v8::Object>();
+  int status = CSOUND_SUCCESS;
+  if (channelsObject->IsArray()) {
+    CSOUND *Csound = CsoundFromFunctionCallbackInfo(info);
+    v8::Local<v8::Array> names = channelsObject.As<v8::Array>();
+    uint32_t channelCount = names->Length();
+    if (values.length() < channelCount) {
+      Nan::ThrowRangeError((std::string("Argument 3 of ") + functionName + " must be at least as long as argument 2.").c_str());
+      return;
+    }
+    for (uint32_t i = 0; i < channelCount; i++) {
+      std::atomic<MYFLT> *channel = getControlChannelPointer(Csound, *Nan::Utf8String(Nan::Get(names, i).ToLocalChecked()), CSOUND_CONTROL_CHANNEL);
+      if (channel)
+        channelFunction(channel, (*values)[i]);
+      else
+        status = CSOUND_ERROR;
+    }
+  } else if (Nan::New(ChannelSetTemplate)->HasInstance(channelsObject)) {
+    ChannelSetWrapper *channelSet = CsoundChannelPointerWrapper::validWrapperFromObject<ChannelSetWrapper>(channelsObject);
+    if (!channelSet)
+      return;
+    size_t channelCount = channelSet->channels.size();
+    if (values.length() < channelCount) {
+      Nan::ThrowRangeError((std::string("Argument 3 of ") + functionName + " must be at least as long as argument 2.").c_str());
+      return;
+    }
+    for (size_t i = 0; i < channelCount; i++) {
+      channelFunction(channelSet->channels[i], (*values)[i]);
+    }
+  } else {
+    Nan::ThrowTypeError((std::string("Argument 2 of ") + functionName + " must be an array or a ChannelSet.").c_str());
+    return;
+  }
+  info.GetReturnValue().Set(Nan::New(status));
+}
+
+static void setControlChannel(std::atomic<MYFLT> *channel, MYFLT &value) {
+  channel->store(value, std::memory_order_relaxed);
+}
+
+static void getControlChannel(std::atomic<MYFLT> *channel, MYFLT &value) {
+  value = channel->load(std::memory_order_relaxed);
+}
+
+static NAN_METHOD(SetControlChannels) {
+  performControlChannelsFunction(info, "SetControlChannels", setControlChannel);
+}
+
+static NAN_METHOD(GetControlChannels) {
+  performControlChannelsFunction(info, "GetControlChannels", getControlChannel);
+}
+
 static NAN_METHOD(ScoreEvent) {
   int status;
   Nan::Utf8String eventTypeString(info[1]);
@@ -1172,11 +4799,13 @@ static NAN_METHOD(ScoreEvent) {
     CSOUNDWrapper *wrapper = Nan::ObjectWrap::Unwrap<CSOUNDWrapper>(info[0].As<v8::Object>());
     if (parameterFieldCount > 0) {
       v8::Local<v8::Object> object = value.As<v8::Object>();
-      MYFLT *parameterFieldValues = (MYFLT *)malloc(sizeof(MYFLT) * parameterFieldCount);
+      std::vector<MYFLT> &parameterFieldValues = wrapper->parameterFieldValueBuffer;
+      if (parameterFieldValues.size() < (size_t)parameterFieldCount)
+        parameterFieldValues.resize(parameterFieldCount);
       for (long i = 0; i < parameterFieldCount; i++) {
         parameterFieldValues[i] = Nan::To<double>(Nan::Get(object, i).ToLocalChecked()).FromJust();
       }
-      status = wrapper->eventHandler->handleScoreEvent(wrapper->Csound, eventType, parameterFieldValues, parameterFieldCount);
+      status = wrapper->eventHandler->handleScoreEvent(wrapper->Csound, eventType, parameterFieldValues.data(), parameterFieldCount);
     } else {
       status = wrapper->eventHandler->handleScoreEvent(wrapper->Csound, eventType, NULL, 0);
     }
@@ -1184,6 +4813,56 @@ static NAN_METHOD(ScoreEvent) {
   info.GetReturnValue().Set(Nan::New(status));
 }
 
+static NAN_METHOD(ScoreEvents) {
+  v8::Local<v8::Value> value = info[2];
+  if (!isMYFLTArray(value)) {
+    Nan::ThrowTypeError("Argument 3 of ScoreEvents must be a " MYFLT_ARRAY_NAME ".");
+    return;
+  }
+  Nan::TypedArrayContents<MYFLT> parameterFieldValues(value);
+
+  value = info[3];
+  if (!value->IsInt32Array()) {
+    Nan::ThrowTypeError("Argument 4 of ScoreEvents must be an Int32Array.");
+    return;
+  }
+  Nan::TypedArrayContents<int32_t> parameterFieldOffsets(value);
+  if (parameterFieldOffsets.length() < 1) {
+    Nan::ThrowRangeError("Argument 4 of ScoreEvents must have a length of at least 1.");
+    return;
+  }
+  long eventCount = parameterFieldOffsets.length() - 1;
+  for (long i = 0; i < eventCount; i++) {
+    if ((*parameterFieldOffsets)[i] < 0 || (*parameterFieldOffsets)[i] > (*parameterFieldOffsets)[i + 1]) {
+      Nan::ThrowRangeError("Argument 4 of ScoreEvents must contain nondecreasing, nonnegative offsets.");
+      return;
+    }
+  }
+  if ((*parameterFieldOffsets)[eventCount] < 0 || (size_t)(*parameterFieldOffsets)[eventCount] > parameterFieldValues.length()) {
+    Nan::ThrowRangeError("Argument 4 of ScoreEvents contains an offset past the end of argument 3.");
+    return;
+  }
+
+  // The event types can be a single character for all events or one character
+  // per event.
+  Nan::Utf8String eventTypeString(info[1]);
+  std::string eventTypes(*eventTypeString, eventTypeString.length());
+  if (eventTypes.length() == 1) {
+    eventTypes.assign(eventCount, eventTypes[0]);
+  } else if (eventTypes.length() != (size_t)eventCount) {
+    info.GetReturnValue().Set(Nan::New(CSOUND_ERROR));
+    return;
+  }
+
+  if (eventCount == 0) {
+    info.GetReturnValue().Set(Nan::New(CSOUND_SUCCESS));
+    return;
+  }
+
+  CSOUNDWrapper *wrapper = Nan::ObjectWrap::Unwrap<CSOUNDWrapper>(info[0].As<v8::Object>());
+  info.GetReturnValue().Set(Nan::New(wrapper->eventHandler->handleScoreEvents(wrapper->Csound, eventTypes.data(), *parameterFieldValues, *parameterFieldOffsets, eventCount)));
+}
+
 static NAN_METHOD(InputMessage) {
   CSOUNDWrapper *wrapper = Nan::ObjectWrap::Unwrap<CSOUNDWrapper>(info[0].As<v8::Object>());
   wrapper->eventHandler->handleInputMessage(wrapper->Csound, *Nan::Utf8String(info[1]));
@@ -1201,28 +4880,135 @@ static NAN_METHOD(TableSet) {
   csoundTableSet(CsoundFromFunctionCallbackInfo(info), Nan::To<int32_t>(info[1]).FromJust(), Nan::To<int32_t>(info[2]).FromJust(), Nan::To<double>(info[3]).FromJust());
 }
 
+// TableCopyOut and TableCopyIn accept Float64Arrays and Float32Arrays, and
+// convert values when the array’s element type isn’t MYFLT. These functions
+// return the length of the function table (or -1 if there is no function table
+// with the number), or throw an exception if the array can’t hold the function
+// table.
+template <typename T>
+static int tableLengthForTypedArrayContents(CSOUND *Csound, int tableNumber, const Nan::TypedArrayContents<T> &contents, const char *functionName) {
+  int length = csoundTableLength(Csound, tableNumber);
+  if (length > 0 && contents.length() < (size_t)length) {
+    Nan::ThrowRangeError((std::string("Argument 3 of ") + functionName + " must be at least as long as the function table.").c_str());
+    return -1;
+  }
+  return length;
+}
+
+template <typename T>
+static int copyTableOut(CSOUND *Csound, int tableNumber, v8::Local<v8::Value> value) {
+  Nan::TypedArrayContents<T> contents(value);
+  int length = tableLengthForTypedArrayContents(Csound, tableNumber, contents, "TableCopyOut");
+  if (length > 0) {
+    MYFLT *table;
+    csoundGetTable(Csound, &table, tableNumber);
+    T *values = *contents;
+    for (int i = 0; i < length; i++) {
+      values[i] = table[i];
+    }
+  }
+  return length;
+}
+
+template <typename T>
+static int copyTableIn(CSOUNDWrapper *wrapper, int tableNumber, v8::Local<v8::Value> value) {
+  Nan::TypedArrayContents<T> contents(value);
+  int length = tableLengthForTypedArrayContents(wrapper->Csound, tableNumber, contents, "TableCopyIn");
+  if (length > 0) {
+    std::vector<MYFLT> values(*contents, *contents + length);
+    wrapper->eventHandler->handleTableCopyIn(wrapper->Csound, tableNumber, values.data(), length);
+  }
+  return length;
+}
+
+static NAN_METHOD(TableCopyOut) {
+  CSOUND *Csound = CsoundFromFunctionCallbackInfo(info);
+  int tableNumber = Nan::To<int32_t>(info[1]).FromJust();
+  v8::Local<v8::Value> value = info[2];
+  int length;
+  if (isMYFLTArray(value)) {
+    Nan::TypedArrayContents<MYFLT> contents(value);
+    length = tableLengthForTypedArrayContents(Csound, tableNumber, contents, "TableCopyOut");
+    if (length > 0)
+      csoundTableCopyOut(Csound, tableNumber, *contents);
+  } else if (value->IsFloat64Array()) {
+    length = copyTableOut<double>(Csound, tableNumber, value);
+  } else if (value->IsFloat32Array()) {
+    length = copyTableOut<float>(Csound, tableNumber, value);
+  } else {
+    Nan::ThrowTypeError("Argument 3 of TableCopyOut must be a Float64Array or a Float32Array.");
+    return;
+  }
+  info.GetReturnValue().Set(Nan::New(length));
+}
+
+static NAN_METHOD(TableCopyIn) {
+  CSOUNDWrapper *wrapper = Nan::ObjectWrap::Unwrap<CSOUNDWrapper>(info[0].As<v8::Object>());
+  int tableNumber = Nan::To<int32_t>(info[1]).FromJust();
+  v8::Local<v8::Value> value = info[2];
+  int length;
+  if (isMYFLTArray(value)) {
+    Nan::TypedArrayContents<MYFLT> contents(value);
+    length = tableLengthForTypedArrayContents(wrapper->Csound, tableNumber, contents, "TableCopyIn");
+    if (length > 0)
+      wrapper->eventHandler->handleTableCopyIn(wrapper->Csound, tableNumber, *contents, length);
+  } else if (value->IsFloat64Array()) {
+    length = copyTableIn<double>(wrapper, tableNumber, value);
+  } else if (value->IsFloat32Array()) {
+    length = copyTableIn<float>(wrapper, tableNumber, value);
+  } else {
+    Nan::ThrowTypeError("Argument 3 of TableCopyIn must be a Float64Array or a Float32Array.");
+    return;
+  }
+  info.GetReturnValue().Set(Nan::New(length));
+}
+
 static NAN_METHOD(SetIsGraphable) {
   info.GetReturnValue().Set(Nan::New((bool)csoundSetIsGraphable(CsoundFromFunctionCallbackInfo(info), Nan::To<bool>(info[1]).FromJust())));
 }
 
 static void CsoundMakeGraphCallback(CSOUND *Csound, WINDAT *windowData, const char *name) {
   CsoundCallback<CsoundMakeGraphCallbackArguments> *CsoundMakeGraphCallbackObject = ((CSOUNDWrapper *)csoundGetHostData(Csound))->CsoundMakeGraphCallbackObject;
-  CsoundMakeGraphCallbackObject->argumentsQueue.push(CsoundMakeGraphCallbackArguments::create(windowData, name));
-  uv_async_send(&(CsoundMakeGraphCallbackObject->handle));
+  CsoundMakeGraphCallbackObject->push(CsoundMakeGraphCallbackArguments::create(windowData, name));
 }
 static CSOUND_CALLBACK_METHOD(MakeGraph)
 
 static void CsoundDrawGraphCallback(CSOUND *Csound, WINDAT *windowData) {
-  CsoundCallback<CsoundGraphCallbackArguments> *CsoundDrawGraphCallbackObject = ((CSOUNDWrapper *)csoundGetHostData(Csound))->CsoundDrawGraphCallbackObject;
-  CsoundDrawGraphCallbackObject->argumentsQueue.push(CsoundGraphCallbackArguments::create(windowData));
-  uv_async_send(&(CsoundDrawGraphCallbackObject->handle));
+  CSOUNDWrapper *wrapper = (CSOUNDWrapper *)csoundGetHostData(Csound);
+  if (wrapper->CsoundDrawGraphCoalescingObject) {
+    wrapper->CsoundDrawGraphCoalescingObject->addFrame(windowData);
+  } else {
+    wrapper->CsoundDrawGraphCallbackObject->push(CsoundGraphCallbackArguments::create(windowData));
+  }
+}
+// SetDrawGraphCallback accepts an options object; when its coalesces property
+// is true, only the most recent frame of each graph is passed to JavaScript.
+static NAN_METHOD(SetDrawGraphCallback) {
+  CSOUNDWrapper *wrapper = Nan::ObjectWrap::Unwrap<CSOUNDWrapper>(info[0].As<v8::Object>());
+  csoundSetDrawGraphCallback(wrapper->Csound, NULL);
+  if (wrapper->CsoundDrawGraphCallbackObject) {
+    wrapper->CsoundDrawGraphCallbackObject->close();
+    wrapper->CsoundDrawGraphCallbackObject = NULL;
+  }
+  if (wrapper->CsoundDrawGraphCoalescingObject) {
+    wrapper->CsoundDrawGraphCoalescingObject->close();
+    wrapper->CsoundDrawGraphCoalescingObject = NULL;
+  }
+
+  v8::Local<v8::Value> value = info[1];
+  if (!value->IsFunction())
+    return;
+  v8::Local<v8::Value> options = info[2];
+  if (options->IsObject() && Nan::To<bool>(Nan::Get(options.As<v8::Object>(), Nan::New("coalesces").ToLocalChecked()).ToLocalChecked()).FromJust())
+    wrapper->CsoundDrawGraphCoalescingObject = new CsoundCoalescingGraphCallback(value.As<v8::Function>());
+  else
+    wrapper->CsoundDrawGraphCallbackObject = new CsoundCallback<CsoundGraphCallbackArguments>(value.As<v8::Function>(), &wrapper->bindingCounters, CsoundBindingCounterDrawGraphQueueDepth);
+  csoundSetDrawGraphCallback(wrapper->Csound, CsoundDrawGraphCallback);
 }
-static CSOUND_CALLBACK_METHOD(DrawGraph, Graph)
 
 static void CsoundKillGraphCallback(CSOUND *Csound, WINDAT *windowData) {
   CsoundCallback<CsoundGraphCallbackArguments> *CsoundKillGraphCallbackObject = ((CSOUNDWrapper *)csoundGetHostData(Csound))->CsoundKillGraphCallbackObject;
-  CsoundKillGraphCallbackObject->argumentsQueue.push(CsoundGraphCallbackArguments::create(windowData));
-  uv_async_send(&(CsoundKillGraphCallbackObject->handle));
+  CsoundKillGraphCallbackObject->push(CsoundGraphCallbackArguments::create(windowData));
 }
 static CSOUND_CALLBACK_METHOD(KillGraph, Graph)
 
@@ -1250,11 +5036,61 @@ static NAN_METHOD(DisposeOpcodeList) {
   performCsoundListDestructionFunction<opcodeListEntry>(info, csoundDisposeOpcodeList);
 }
 
+static NAN_METHOD(GetOpcodeTable) {
+  std::shared_ptr<CsoundOpcodeIndex> index = opcodeIndexForWrapper(Nan::ObjectWrap::Unwrap<CSOUNDWrapper>(info[0].As<v8::Object>()));
+  if (!index) {
+    info.GetReturnValue().SetNull();
+    return;
+  }
+  v8::Local<v8::Object> table = Nan::New<v8::Object>();
+  Nan::Set(table, Nan::New("length").ToLocalChecked(), Nan::New((uint32_t)index->size()));
+  v8::Local<v8::Array> stringArray = Nan::New<v8::Array>(index->strings.size());
+  for (uint32_t i = 0; i < index->strings.size(); i++) {
+    Nan::Set(stringArray, i, Nan::New(index->strings[i]).ToLocalChecked());
+  }
+  Nan::Set(table, Nan::New("strings").ToLocalChecked(), stringArray);
+  Nan::Set(table, Nan::New("names").ToLocalChecked(), CsoundTreeFlattener::newTypedArray<v8::Uint32Array>(index->nameIndexes));
+  Nan::Set(table, Nan::New("outypes").ToLocalChecked(), CsoundTreeFlattener::newTypedArray<v8::Uint32Array>(index->outypesIndexes));
+  Nan::Set(table, Nan::New("intypes").ToLocalChecked(), CsoundTreeFlattener::newTypedArray<v8::Uint32Array>(index->intypesIndexes));
+  Nan::Set(table, Nan::New("flags").ToLocalChecked(), CsoundTreeFlattener::newTypedArray<v8::Int32Array>(index->flags));
+  info.GetReturnValue().Set(table);
+}
+
+static NAN_METHOD(GetOpcodeSignatures) {
+  std::shared_ptr<CsoundOpcodeIndex> index = opcodeIndexForWrapper(Nan::ObjectWrap::Unwrap<CSOUNDWrapper>(info[0].As<v8::Object>()));
+  if (!index) {
+    info.GetReturnValue().SetNull();
+    return;
+  }
+  std::string name(*Nan::Utf8String(info[1]));
+  auto iterator = index->entryIndexesByName.find(name.substr(0, name.find('.')));
+  if (iterator == index->entryIndexesByName.end()) {
+    info.GetReturnValue().SetNull();
+    return;
+  }
+  const std::vector<uint32_t> &entryIndexes = iterator->second;
+  v8::Local<v8::String> outypesKey = Nan::New("outypes").ToLocalChecked();
+  v8::Local<v8::String> intypesKey = Nan::New("intypes").ToLocalChecked();
+  v8::Local<v8::String> flagsKey = Nan::New("flags").ToLocalChecked();
+  v8::Local<v8::Array> signatures = Nan::New<v8::Array>(entryIndexes.size());
+  for (uint32_t i = 0; i < entryIndexes.size(); i++) {
+    uint32_t entryIndex = entryIndexes[i];
+    v8::Local<v8::Object> signature = Nan::New<v8::Object>();
+    Nan::Set(signature, outypesKey, Nan::New(index->strings[index->outypesIndexes[entryIndex]]).ToLocalChecked());
+    Nan::Set(signature, intypesKey, Nan::New(index->strings[index->intypesIndexes[entryIndex]]).ToLocalChecked());
+    Nan::Set(signature, flagsKey, Nan::New(index->flags[entryIndex]));
+    Nan::Set(signatures, i, signature);
+  }
+  info.GetReturnValue().Set(signatures);
+}
+
 static NAN_METHOD(GetEnv) {
   setReturnValueWithCString(info.GetReturnValue(), csoundGetEnv(CsoundFromFunctionCallbackInfo(info), *Nan::Utf8String(info[1])));
 }
 
 static NAN_METHOD(SetGlobalEnv) {
+  // Instances created after this may load different plugins.
+  CsoundOpcodeIndexGeneration++;
   info.GetReturnValue().Set(csoundSetGlobalEnv(*Nan::Utf8String(info[0]), *Nan::Utf8String(info[1])));
 }
 
@@ -1505,45 +5341,62 @@ static NAN_MODULE_INIT(init) {
   Nan::SetAccessor(target, Nan::New("INIT_NO_ATEXIT").ToLocalChecked(), CsoundInitializationOption::NoExitFunction);
 
   Nan::SetMethod(target, "Create", Create);
-  Nan::SetMethod(target, "Destroy", Destroy);
+  setCsoundMethod<Destroy>(target, "Destroy");
+  Nan::SetMethod(target, "CreateInstancePool", CreateInstancePool);
   Nan::SetMethod(target, "GetVersion", GetVersion);
   Nan::SetMethod(target, "GetAPIVersion", GetAPIVersion);
 
-  Nan::SetMethod(target, "ParseOrc", ParseOrc);
-  Nan::SetMethod(target, "CompileTree", CompileTree);
-  Nan::SetMethod(target, "DeleteTree", DeleteTree);
-  Nan::SetMethod(target, "CompileOrc", CompileOrc);
-  Nan::SetMethod(target, "EvalCode", EvalCode);
-  Nan::SetMethod(target, "CompileArgs", CompileArgs);
-  Nan::SetMethod(target, "Start", Start);
-  Nan::SetMethod(target, "Compile", Compile);
-  Nan::SetMethod(target, "CompileCsd", CompileCsd);
-  Nan::SetMethod(target, "PerformAsync", PerformAsync);
-  Nan::SetMethod(target, "Perform", Perform);
-  Nan::SetMethod(target, "PerformKsmpsAsync", PerformKsmpsAsync);
-  Nan::SetMethod(target, "PerformKsmps", PerformKsmps);
-  Nan::SetMethod(target, "PerformBuffer", PerformBuffer);
-  Nan::SetMethod(target, "Stop", Stop);
-  Nan::SetMethod(target, "Cleanup", Cleanup);
-  Nan::SetMethod(target, "Reset", Reset);
-
-  Nan::SetMethod(target, "GetSr", GetSr);
-  Nan::SetMethod(target, "GetKr", GetKr);
-  Nan::SetMethod(target, "GetKsmps", GetKsmps);
-  Nan::SetMethod(target, "GetNchnls", GetNchnls);
-  Nan::SetMethod(target, "GetNchnlsInput", GetNchnlsInput);
-  Nan::SetMethod(target, "Get0dBFS", Get0dBFS);
-  Nan::SetMethod(target, "GetCurrentTimeSamples", GetCurrentTimeSamples);
+  setCsoundMethod<ParseOrc>(target, "ParseOrc");
+  setCsoundMethod<CompileTree>(target, "CompileTree");
+  setCsoundMethod<DeleteTree>(target, "DeleteTree");
+  Nan::SetMethod(target, "SerializeTree", SerializeTree);
+  setCsoundMethod<QueryTree>(target, "QueryTree");
+  setCsoundMethod<CompileOrc>(target, "CompileOrc");
+  setCsoundMethod<SetParseTreeCache>(target, "SetParseTreeCache");
+  setCsoundMethod<GetParseTreeCacheStats>(target, "GetParseTreeCacheStats");
+  setCsoundMethod<EvalCode>(target, "EvalCode");
+  setCsoundMethod<CompileArgs>(target, "CompileArgs");
+  setCsoundMethod<Start>(target, "Start");
+  setCsoundMethod<Compile>(target, "Compile");
+  setCsoundMethod<CompileCsd>(target, "CompileCsd");
+  setCsoundMethod<CompileOrcAsync>(target, "CompileOrcAsync");
+  setCsoundMethod<CompileCsdAsync>(target, "CompileCsdAsync");
+  setCsoundMethod<CompileArgsAsync>(target, "CompileArgsAsync");
+  setCsoundMethod<CompileAsync>(target, "CompileAsync");
+  setCsoundMethod<StartAsync>(target, "StartAsync");
+  setCsoundMethod<PerformAsync>(target, "PerformAsync");
+  setCsoundMethod<RenderAsync>(target, "RenderAsync");
+  Nan::SetMethod(target, "CreateRenderPool", CreateRenderPool);
+  setCsoundMethod<Perform>(target, "Perform");
+  setCsoundMethod<PerformKsmpsAsync>(target, "PerformKsmpsAsync");
+  setCsoundMethod<PerformKsmps>(target, "PerformKsmps");
+  setCsoundMethod<PerformBuffer>(target, "PerformBuffer");
+  setCsoundMethod<Stop>(target, "Stop");
+  setCsoundMethod<GetPerformanceStats>(target, "GetPerformanceStats");
+  setCsoundMethod<GetBindingCounters>(target, "GetBindingCounters");
+  Nan::SetMethod(target, "GetBindingCounterNames", GetBindingCounterNames);
+  setCsoundMethod<CreateOutputStream>(target, "CreateOutputStream");
+  setCsoundMethod<CreateInputStream>(target, "CreateInputStream");
+  setCsoundMethod<Cleanup>(target, "Cleanup");
+  setCsoundMethod<Reset>(target, "Reset");
+
+  setCsoundMethod<GetSr>(target, "GetSr");
+  setCsoundMethod<GetKr>(target, "GetKr");
+  setCsoundMethod<GetKsmps>(target, "GetKsmps");
+  setCsoundMethod<GetNchnls>(target, "GetNchnls");
+  setCsoundMethod<GetNchnlsInput>(target, "GetNchnlsInput");
+  setCsoundMethod<Get0dBFS>(target, "Get0dBFS");
+  setCsoundMethod<GetCurrentTimeSamples>(target, "GetCurrentTimeSamples");
   Nan::SetMethod(target, "GetSizeOfMYFLT", GetSizeOfMYFLT);
-  Nan::SetMethod(target, "GetHostData", GetHostData);
-  Nan::SetMethod(target, "SetHostData", SetHostData);
-  Nan::SetMethod(target, "SetOption", SetOption);
-  Nan::SetMethod(target, "GetDebug", GetDebug);
-  Nan::SetMethod(target, "SetDebug", SetDebug);
+  setCsoundMethod<GetHostData>(target, "GetHostData");
+  setCsoundMethod<SetHostData>(target, "SetHostData");
+  setCsoundMethod<SetOption>(target, "SetOption");
+  setCsoundMethod<GetDebug>(target, "GetDebug");
+  setCsoundMethod<SetDebug>(target, "SetDebug");
 
-  Nan::SetMethod(target, "GetOutputName", GetOutputName);
-  Nan::SetMethod(target, "SetOutput", SetOutput);
-  Nan::SetMethod(target, "SetFileOpenCallback", SetFileOpenCallback);
+  setCsoundMethod<GetOutputName>(target, "GetOutputName");
+  setCsoundMethod<SetOutput>(target, "SetOutput");
+  setCsoundMethod<SetFileOpenCallback>(target, "SetFileOpenCallback");
 
   Nan::SetAccessor(target, Nan::New("FTYPE_RAW_AUDIO").ToLocalChecked(), CsoundFileType::RawAudio);
   Nan::SetAccessor(target, Nan::New("FTYPE_IRCAM").ToLocalChecked(), CsoundFileType::IRCAM);
@@ -1573,26 +5426,29 @@ static NAN_MODULE_INIT(init) {
   Nan::SetAccessor(target, Nan::New("FTYPE_XI").ToLocalChecked(), CsoundFileType::XI);
   Nan::SetAccessor(target, Nan::New("FTYPE_UNKNOWN_AUDIO").ToLocalChecked(), CsoundFileType::UnknownAudio);
 
-  Nan::SetMethod(target, "ReadScore", ReadScore);
-  Nan::SetMethod(target, "GetScoreTime", GetScoreTime);
-  Nan::SetMethod(target, "IsScorePending", IsScorePending);
-  Nan::SetMethod(target, "SetScorePending", SetScorePending);
-  Nan::SetMethod(target, "GetScoreOffsetSeconds", GetScoreOffsetSeconds);
-  Nan::SetMethod(target, "SetScoreOffsetSeconds", SetScoreOffsetSeconds);
-  Nan::SetMethod(target, "RewindScore", RewindScore);
+  setCsoundMethod<GetSpin>(target, "GetSpin");
+  setCsoundMethod<GetSpout>(target, "GetSpout");
+
+  setCsoundMethod<ReadScore>(target, "ReadScore");
+  setCsoundMethod<GetScoreTime>(target, "GetScoreTime");
+  setCsoundMethod<IsScorePending>(target, "IsScorePending");
+  setCsoundMethod<SetScorePending>(target, "SetScorePending");
+  setCsoundMethod<GetScoreOffsetSeconds>(target, "GetScoreOffsetSeconds");
+  setCsoundMethod<SetScoreOffsetSeconds>(target, "SetScoreOffsetSeconds");
+  setCsoundMethod<RewindScore>(target, "RewindScore");
 
-  Nan::SetMethod(target, "Message", Message);
-  Nan::SetMethod(target, "MessageS", MessageS);
+  setCsoundMethod<Message>(target, "Message");
+  setCsoundMethod<MessageS>(target, "MessageS");
   Nan::SetMethod(target, "SetDefaultMessageCallback", SetDefaultMessageCallback);
-  Nan::SetMethod(target, "SetMessageCallback", SetMessageCallback);
-  Nan::SetMethod(target, "GetMessageLevel", GetMessageLevel);
-  Nan::SetMethod(target, "SetMessageLevel", SetMessageLevel);
-  Nan::SetMethod(target, "CreateMessageBuffer", CreateMessageBuffer);
-  Nan::SetMethod(target, "GetFirstMessage", GetFirstMessage);
-  Nan::SetMethod(target, "GetFirstMessageAttr", GetFirstMessageAttr);
-  Nan::SetMethod(target, "PopFirstMessage", PopFirstMessage);
-  Nan::SetMethod(target, "GetMessageCnt", GetMessageCnt);
-  Nan::SetMethod(target, "DestroyMessageBuffer", DestroyMessageBuffer);
+  setCsoundMethod<SetMessageCallback>(target, "SetMessageCallback");
+  setCsoundMethod<GetMessageLevel>(target, "GetMessageLevel");
+  setCsoundMethod<SetMessageLevel>(target, "SetMessageLevel");
+  setCsoundMethod<CreateMessageBuffer>(target, "CreateMessageBuffer");
+  setCsoundMethod<GetFirstMessage>(target, "GetFirstMessage");
+  setCsoundMethod<GetFirstMessageAttr>(target, "GetFirstMessageAttr");
+  setCsoundMethod<PopFirstMessage>(target, "PopFirstMessage");
+  setCsoundMethod<GetMessageCnt>(target, "GetMessageCnt");
+  setCsoundMethod<DestroyMessageBuffer>(target, "DestroyMessageBuffer");
 
   Nan::SetAccessor(target, Nan::New("MSG_DEFAULT").ToLocalChecked(), CsoundMessageType::Default);
   Nan::SetAccessor(target, Nan::New("MSG_ERROR").ToLocalChecked(), CsoundMessageType::Error);
@@ -1625,14 +5481,21 @@ static NAN_MODULE_INIT(init) {
   Nan::SetAccessor(target, Nan::New("MSG_BG_GREY").ToLocalChecked(), CsoundMessageBackgroundColor::Grey);
   Nan::SetAccessor(target, Nan::New("MSG_BG_COLOR_MASK").ToLocalChecked(), CsoundMessageBackgroundColor::Mask);
 
-  Nan::SetMethod(target, "ListChannels", ListChannels);
-  Nan::SetMethod(target, "DeleteChannelList", DeleteChannelList);
-  Nan::SetMethod(target, "GetControlChannelHints", GetControlChannelHints);
-  Nan::SetMethod(target, "SetControlChannelHints", SetControlChannelHints);
-  Nan::SetMethod(target, "GetControlChannel", GetControlChannel);
-  Nan::SetMethod(target, "SetControlChannel", SetControlChannel);
-  Nan::SetMethod(target, "ScoreEvent", ScoreEvent);
-  Nan::SetMethod(target, "InputMessage", InputMessage);
+  setCsoundMethod<ListChannels>(target, "ListChannels");
+  setCsoundMethod<DeleteChannelList>(target, "DeleteChannelList");
+  setCsoundMethod<GetControlChannelHints>(target, "GetControlChannelHints");
+  setCsoundMethod<SetControlChannelHints>(target, "SetControlChannelHints");
+  setCsoundMethod<GetControlChannel>(target, "GetControlChannel");
+  setCsoundMethod<SetControlChannel>(target, "SetControlChannel");
+  setCsoundMethod<GetChannelHandle>(target, "GetChannelHandle");
+  setCsoundMethod<GetChannelSet>(target, "GetChannelSet");
+  setCsoundMethod<SetControlChannels>(target, "SetControlChannels");
+  setCsoundMethod<GetControlChannels>(target, "GetControlChannels");
+  setCsoundMethod<GetAudioChannel>(target, "GetAudioChannel");
+  setCsoundMethod<SetAudioChannel>(target, "SetAudioChannel");
+  setCsoundMethod<ScoreEvent>(target, "ScoreEvent");
+  setCsoundMethod<ScoreEvents>(target, "ScoreEvents");
+  setCsoundMethod<InputMessage>(target, "InputMessage");
 
   Nan::SetAccessor(target, Nan::New("CONTROL_CHANNEL").ToLocalChecked(), CsoundControlChannelType::Control);
   Nan::SetAccessor(target, Nan::New("AUDIO_CHANNEL").ToLocalChecked(), CsoundControlChannelType::Audio);
@@ -1647,23 +5510,27 @@ static NAN_MODULE_INIT(init) {
   Nan::SetAccessor(target, Nan::New("CONTROL_CHANNEL_LIN").ToLocalChecked(), CsoundControlChannelBehavior::Linear);
   Nan::SetAccessor(target, Nan::New("CONTROL_CHANNEL_EXP").ToLocalChecked(), CsoundControlChannelBehavior::Exponential);
 
-  Nan::SetMethod(target, "TableLength", TableLength);
-  Nan::SetMethod(target, "TableGet", TableGet);
-  Nan::SetMethod(target, "TableSet", TableSet);
+  setCsoundMethod<TableLength>(target, "TableLength");
+  setCsoundMethod<TableGet>(target, "TableGet");
+  setCsoundMethod<TableSet>(target, "TableSet");
+  setCsoundMethod<TableCopyOut>(target, "TableCopyOut");
+  setCsoundMethod<TableCopyIn>(target, "TableCopyIn");
 
-  Nan::SetMethod(target, "SetIsGraphable", SetIsGraphable);
-  Nan::SetMethod(target, "SetMakeGraphCallback", SetMakeGraphCallback);
-  Nan::SetMethod(target, "SetDrawGraphCallback", SetDrawGraphCallback);
-  Nan::SetMethod(target, "SetKillGraphCallback", SetKillGraphCallback);
+  setCsoundMethod<SetIsGraphable>(target, "SetIsGraphable");
+  setCsoundMethod<SetMakeGraphCallback>(target, "SetMakeGraphCallback");
+  setCsoundMethod<SetDrawGraphCallback>(target, "SetDrawGraphCallback");
+  setCsoundMethod<SetKillGraphCallback>(target, "SetKillGraphCallback");
 
-  Nan::SetMethod(target, "NewOpcodeList", NewOpcodeList);
-  Nan::SetMethod(target, "DisposeOpcodeList", DisposeOpcodeList);
+  setCsoundMethod<NewOpcodeList>(target, "NewOpcodeList");
+  setCsoundMethod<DisposeOpcodeList>(target, "DisposeOpcodeList");
+  setCsoundMethod<GetOpcodeTable>(target, "GetOpcodeTable");
+  setCsoundMethod<GetOpcodeSignatures>(target, "GetOpcodeSignatures");
 
-  Nan::SetMethod(target, "GetEnv", GetEnv);
+  setCsoundMethod<GetEnv>(target, "GetEnv");
   Nan::SetMethod(target, "SetGlobalEnv", SetGlobalEnv);
-  Nan::SetMethod(target, "ListUtilities", ListUtilities);
-  Nan::SetMethod(target, "DeleteUtilityList", DeleteUtilityList);
-  Nan::SetMethod(target, "GetUtilityDescription", GetUtilityDescription);
+  setCsoundMethod<ListUtilities>(target, "ListUtilities");
+  setCsoundMethod<DeleteUtilityList>(target, "DeleteUtilityList");
+  setCsoundMethod<GetUtilityDescription>(target, "GetUtilityDescription");
 
   Nan::SetAccessor(target, Nan::New("SUCCESS").ToLocalChecked(), CsoundStatus::Success);
   Nan::SetAccessor(target, Nan::New("ERROR").ToLocalChecked(), CsoundStatus::Error);
@@ -1718,6 +5585,60 @@ static NAN_MODULE_INIT(init) {
   Nan::SetAccessor(instanceTemplate, Nan::New("hints").ToLocalChecked(), ChannelInfoWrapper::hints);
   ChannelInfoProxyConstructor.Reset(Nan::GetFunction(classTemplate).ToLocalChecked());
 
+  classTemplate = Nan::New<v8::FunctionTemplate>(ChannelHandleWrapper::New);
+  classTemplate->SetClassName(Nan::New("ChannelHandle").ToLocalChecked());
+  classTemplate->InstanceTemplate()->SetInternalFieldCount(1);
+  Nan::SetPrototypeMethod(classTemplate, "get", ChannelHandleWrapper::get);
+  Nan::SetPrototypeMethod(classTemplate, "set", ChannelHandleWrapper::set);
+  ChannelHandleProxyConstructor.Reset(Nan::GetFunction(classTemplate).ToLocalChecked());
+
+  classTemplate = Nan::New<v8::FunctionTemplate>(ChannelSetWrapper::New);
+  classTemplate->SetClassName(Nan::New("ChannelSet").ToLocalChecked());
+  instanceTemplate = classTemplate->InstanceTemplate();
+  instanceTemplate->SetInternalFieldCount(1);
+  Nan::SetAccessor(instanceTemplate, Nan::New("length").ToLocalChecked(), ChannelSetWrapper::length);
+  ChannelSetProxyConstructor.Reset(Nan::GetFunction(classTemplate).ToLocalChecked());
+  ChannelSetTemplate.Reset(classTemplate);
+
+  classTemplate = Nan::New<v8::FunctionTemplate>(CsoundOutputStreamWrapper::New);
+  classTemplate->SetClassName(Nan::New("OutputStream").ToLocalChecked());
+  instanceTemplate = classTemplate->InstanceTemplate();
+  instanceTemplate->SetInternalFieldCount(1);
+  Nan::SetPrototypeMethod(classTemplate, "pause", CsoundOutputStreamWrapper::pause);
+  Nan::SetPrototypeMethod(classTemplate, "resume", CsoundOutputStreamWrapper::resume);
+  Nan::SetAccessor(instanceTemplate, Nan::New("droppedFrameCount").ToLocalChecked(), CsoundOutputStreamWrapper::droppedFrameCount);
+  OutputStreamProxyConstructor.Reset(Nan::GetFunction(classTemplate).ToLocalChecked());
+
+  classTemplate = Nan::New<v8::FunctionTemplate>(CsoundInputStreamWrapper::New);
+  classTemplate->SetClassName(Nan::New("InputStream").ToLocalChecked());
+  instanceTemplate = classTemplate->InstanceTemplate();
+  instanceTemplate->SetInternalFieldCount(1);
+  Nan::SetPrototypeMethod(classTemplate, "write", CsoundInputStreamWrapper::write);
+  Nan::SetPrototypeMethod(classTemplate, "end", CsoundInputStreamWrapper::end);
+  Nan::SetAccessor(instanceTemplate, Nan::New("underrunFrameCount").ToLocalChecked(), CsoundInputStreamWrapper::underrunFrameCount);
+  InputStreamProxyConstructor.Reset(Nan::GetFunction(classTemplate).ToLocalChecked());
+
+  classTemplate = Nan::New<v8::FunctionTemplate>(CsoundInstancePoolWrapper::New);
+  classTemplate->SetClassName(Nan::New("InstancePool").ToLocalChecked());
+  instanceTemplate = classTemplate->InstanceTemplate();
+  instanceTemplate->SetInternalFieldCount(1);
+  Nan::SetPrototypeMethod(classTemplate, "acquire", CsoundInstancePoolWrapper::acquire);
+  Nan::SetPrototypeMethod(classTemplate, "release", CsoundInstancePoolWrapper::release);
+  Nan::SetPrototypeMethod(classTemplate, "close", CsoundInstancePoolWrapper::close);
+  Nan::SetAccessor(instanceTemplate, Nan::New("idleCount").ToLocalChecked(), CsoundInstancePoolWrapper::idleCount);
+  Nan::SetAccessor(instanceTemplate, Nan::New("acquisitionStats").ToLocalChecked(), CsoundInstancePoolWrapper::acquisitionStats);
+  InstancePoolProxyConstructor.Reset(Nan::GetFunction(classTemplate).ToLocalChecked());
+
+  classTemplate = Nan::New<v8::FunctionTemplate>(CsoundRenderPoolWrapper::New);
+  classTemplate->SetClassName(Nan::New("RenderPool").ToLocalChecked());
+  instanceTemplate = classTemplate->InstanceTemplate();
+  instanceTemplate->SetInternalFieldCount(1);
+  Nan::SetPrototypeMethod(classTemplate, "render", CsoundRenderPoolWrapper::render);
+  Nan::SetPrototypeMethod(classTemplate, "close", CsoundRenderPoolWrapper::close);
+  Nan::SetAccessor(instanceTemplate, Nan::New("threadCount").ToLocalChecked(), CsoundRenderPoolWrapper::threadCount);
+  Nan::SetAccessor(instanceTemplate, Nan::New("pendingJobCount").ToLocalChecked(), CsoundRenderPoolWrapper::pendingJobCount);
+  RenderPoolProxyConstructor.Reset(Nan::GetFunction(classTemplate).ToLocalChecked());
+
   classTemplate = Nan::New<v8::FunctionTemplate>(WINDATWrapper::New);
   classTemplate->SetClassName(Nan::New("WINDAT").ToLocalChecked());
   instanceTemplate = classTemplate->InstanceTemplate();
@@ -1751,14 +5672,14 @@ static NAN_MODULE_INIT(init) {
   UtilityNameListProxyConstructor.Reset(Nan::GetFunction(classTemplate).ToLocalChecked());
 
 #if CSOUND_6_04_OR_LATER
-  Nan::SetMethod(target, "DebuggerInit", DebuggerInit);
-  Nan::SetMethod(target, "DebuggerClean", DebuggerClean);
-  Nan::SetMethod(target, "SetInstrumentBreakpoint", SetInstrumentBreakpoint);
-  Nan::SetMethod(target, "RemoveInstrumentBreakpoint", RemoveInstrumentBreakpoint);
-  Nan::SetMethod(target, "ClearBreakpoints", ClearBreakpoints);
-  Nan::SetMethod(target, "SetBreakpointCallback", SetBreakpointCallback);
-  Nan::SetMethod(target, "DebugContinue", DebugContinue);
-  Nan::SetMethod(target, "DebugStop", DebugStop);
+  setCsoundMethod<DebuggerInit>(target, "DebuggerInit");
+  setCsoundMethod<DebuggerClean>(target, "DebuggerClean");
+  setCsoundMethod<SetInstrumentBreakpoint>(target, "SetInstrumentBreakpoint");
+  setCsoundMethod<RemoveInstrumentBreakpoint>(target, "RemoveInstrumentBreakpoint");
+  setCsoundMethod<ClearBreakpoints>(target, "ClearBreakpoints");
+  setCsoundMethod<SetBreakpointCallback>(target, "SetBreakpointCallback");
+  setCsoundMethod<DebugContinue>(target, "DebugContinue");
+  setCsoundMethod<DebugStop>(target, "DebugStop");
 
   classTemplate = Nan::New<v8::FunctionTemplate>(DebuggerInstrumentWrapper::New);
   classTemplate->SetClassName(Nan::New("debug_instr_t").ToLocalChecked());